@@ -0,0 +1,29 @@
+#pragma once
+#include <wut.h>
+
+typedef enum FSError {
+    FS_ERROR_OK                   = 0,
+    FS_ERROR_INVALID_PARAM        = -0x30021,
+    FS_ERROR_INVALID_PATH         = -0x30022,
+    FS_ERROR_INVALID_BUFFER       = -0x30023,
+    FS_ERROR_INVALID_ALIGNMENT    = -0x30024,
+    FS_ERROR_INVALID_CLIENTHANDLE = -0x30025,
+    FS_ERROR_OUT_OF_RESOURCES     = -0x3002C,
+    FS_ERROR_MEDIA_ERROR          = -0x30041,
+} FSError;
+
+typedef struct FSClient FSClient;
+
+typedef struct FSClientBody {
+    int32_t clientHandle;
+} FSClientBody;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FSClientBody *FSGetClientBody(FSClient *client);
+
+#ifdef __cplusplus
+}
+#endif
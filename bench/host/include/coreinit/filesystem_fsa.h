@@ -0,0 +1,78 @@
+#pragma once
+#include <coreinit/filesystem.h>
+#include <coreinit/ios.h>
+#include <wut.h>
+
+typedef IOSHandle FSAClientHandle;
+
+typedef enum FSACommandEnum {
+    FSA_COMMAND_READ_FILE  = 0xF,
+    FSA_COMMAND_WRITE_FILE = 0x10,
+    FSA_COMMAND_RAW_OPEN   = 0x6A,
+    FSA_COMMAND_RAW_READ   = 0x6B,
+    FSA_COMMAND_RAW_WRITE  = 0x6C,
+    FSA_COMMAND_RAW_CLOSE  = 0x6D,
+} FSACommandEnum;
+
+typedef enum FSAIpcRequestTypeEnum {
+    FSA_IPC_REQUEST_IOCTL  = 0,
+    FSA_IPC_REQUEST_IOCTLV = 1,
+} FSAIpcRequestTypeEnum;
+
+typedef struct WUT_PACKED FSARequestRawOpen {
+    char path[0x280];
+} FSARequestRawOpen;
+
+typedef struct WUT_PACKED FSARequestRawClose {
+    int32_t handle;
+} FSARequestRawClose;
+
+typedef struct WUT_PACKED FSARequestRawRead {
+    uint32_t unk0;
+    uint64_t blocks_offset;
+    uint32_t count;
+    uint32_t size;
+    uint32_t device_handle;
+} FSARequestRawRead;
+
+typedef struct WUT_PACKED FSARequest {
+    FSError emulatedError;
+    union WUT_PACKED {
+        FSARequestRawOpen rawOpen;
+        FSARequestRawClose rawClose;
+        FSARequestRawRead rawRead;
+        FSARequestRawRead rawWrite;
+    };
+} FSARequest;
+
+typedef struct WUT_PACKED FSAResponseRawOpen {
+    int32_t handle;
+} FSAResponseRawOpen;
+
+typedef struct WUT_PACKED FSAResponse {
+    uint32_t word0;
+    union WUT_PACKED {
+        FSAResponseRawOpen rawOpen;
+    };
+} FSAResponse;
+
+typedef struct FSAShimBuffer {
+    FSARequest request;
+    FSAResponse response;
+    IOSVec ioctlvVec[3];
+    FSAClientHandle clientHandle;
+    FSACommandEnum command;
+    FSAIpcRequestTypeEnum ipcReqType;
+    uint8_t ioctlvVecIn;
+    uint8_t ioctlvVecOut;
+} FSAShimBuffer;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+FSError __FSAShimDecodeIosErrorToFsaStatus(IOSHandle handle, IOSError error);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+#include <wut.h>
+
+typedef int32_t IOSHandle;
+
+typedef enum IOSError {
+    IOS_ERROR_OK = 0,
+} IOSError;
+
+typedef struct IOSVec {
+    uint32_t paddr;
+    uint32_t len;
+    void *vaddr;
+} IOSVec;
+
+typedef void (*IOSAsyncCallbackFn)(IOSError error, void *context);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+IOSError IOS_IoctlvAsync(IOSHandle handle, uint32_t request, uint32_t vecIn, uint32_t vecOut, IOSVec *vec, IOSAsyncCallbackFn callback, void *context);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+#include <wut.h>
+
+typedef struct OSMessage {
+    void *message;
+    uint32_t args[3];
+} OSMessage;
+
+typedef enum OSMessageFlags {
+    OS_MESSAGE_FLAGS_NONE     = 0,
+    OS_MESSAGE_FLAGS_BLOCKING = 1 << 0,
+} OSMessageFlags;
+
+typedef struct OSMessageQueue {
+    OSMessage *messages;
+    uint32_t size;
+    uint32_t first;
+    uint32_t used;
+} OSMessageQueue;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool OSSendMessage(OSMessageQueue *queue, OSMessage *message, OSMessageFlags flags);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,10 @@
+#pragma once
+#include <coreinit/time.h>
+#include <wut.h>
+
+typedef enum OSThreadAttributes {
+    OS_THREAD_ATTRIB_AFFINITY_CPU0 = 1 << 0,
+    OS_THREAD_ATTRIB_AFFINITY_CPU1 = 1 << 1,
+    OS_THREAD_ATTRIB_AFFINITY_CPU2 = 1 << 2,
+    OS_THREAD_ATTRIB_AFFINITY_ANY  = 7,
+} OSThreadAttributes;
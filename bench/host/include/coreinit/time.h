@@ -0,0 +1,19 @@
+#pragma once
+#include <wut.h>
+
+typedef int64_t OSTime;
+
+// Bus clock / 4 of the Wii U
+#define OSTimerClockSpeed            62156250
+#define OSTicksToMicroseconds(ticks) (((uint64_t) (ticks) * 8000) / (OSTimerClockSpeed / 125))
+#define OSMicrosecondsToTicks(val)   (((uint64_t) (val) * (OSTimerClockSpeed / 125)) / 8000)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+OSTime OSGetTime();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,8 @@
+#pragma once
+// Minimal subset of the wut headers, just enough to compile source/fsa.cpp and source/fsa_shim_pool.cpp
+// for the host. The structure layouts don't match the console, only the fields used by libmocha exist.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WUT_PACKED __attribute__((__packed__))
@@ -0,0 +1,80 @@
+#include "bench.h"
+#include "stubs.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mocha/fsa.h>
+
+void BenchPrintf(const char *fmt, ...) {
+    va_list va;
+    va_start(va, fmt);
+    vprintf(fmt, va);
+    va_end(va);
+}
+
+static void PrintUsage(const char *name) {
+    printf("Usage: %s [options]\n"
+           "  --latency-us <n>    fixed latency of every request (default 200)\n"
+           "  --bandwidth <n>     transfer rate of the device in MiB/s, 0 for infinite (default 20)\n"
+           "  --jitter-us <n>     random latency of up to n microseconds per request (default 0)\n"
+           "  --sleep             sleep for the latency instead of simulating the elapsed time\n"
+           "  --sector-size <n>   sector size in bytes (default 512)\n"
+           "  --run-kib <n>       KiB transferred per combination (default 16384)\n"
+           "  --verbose           print the log of libmocha\n",
+           name);
+}
+
+int main(int argc, char **argv) {
+    gLatencyModel.baseMicroseconds   = 200;
+    gLatencyModel.mibPerSecond       = 20;
+    gLatencyModel.jitterMicroseconds = 0;
+
+    BenchConfig config{};
+    config.clientHandle = 1;
+    config.sectorSize   = 512;
+    config.firstSector  = 0;
+    config.numSectors   = 0x100000;
+    config.bytesPerRun  = 16 * 1024 * 1024;
+    config.allowWrites  = true;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg   = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!strcmp(arg, "--sleep")) {
+            gLatencyModel.sleep = true;
+        } else if (!strcmp(arg, "--verbose")) {
+            gLatencyModel.verbose = true;
+        } else if (value && !strcmp(arg, "--latency-us")) {
+            gLatencyModel.baseMicroseconds = strtoul(value, nullptr, 0);
+            i++;
+        } else if (value && !strcmp(arg, "--bandwidth")) {
+            gLatencyModel.mibPerSecond = strtoul(value, nullptr, 0);
+            i++;
+        } else if (value && !strcmp(arg, "--jitter-us")) {
+            gLatencyModel.jitterMicroseconds = strtoul(value, nullptr, 0);
+            i++;
+        } else if (value && !strcmp(arg, "--sector-size")) {
+            config.sectorSize = strtoul(value, nullptr, 0);
+            i++;
+        } else if (value && !strcmp(arg, "--run-kib")) {
+            config.bytesPerRun = strtoul(value, nullptr, 0) * 1024;
+            i++;
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    printf("Simulated device: %u us per request, %u MiB/s, up to %u us jitter%s\n",
+           gLatencyModel.baseMicroseconds, gLatencyModel.mibPerSecond, gLatencyModel.jitterMicroseconds,
+           gLatencyModel.sleep ? ", sleeping" : "");
+
+    if (FSAEx_RawOpenEx(config.clientHandle, "/dev/sdcard01", &config.deviceHandle) < 0) {
+        printf("FSAEx_RawOpenEx failed\n");
+        return 1;
+    }
+    const bool result = BenchRun(config);
+    FSAEx_RawCloseEx(config.clientHandle, config.deviceHandle);
+    return result ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+#include "stubs.h"
+#include "utils.h"
+#include <chrono>
+#include <coreinit/debug.h>
+#include <coreinit/filesystem_fsa.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/time.h>
+#include <cstdarg>
+#include <cstdio>
+#include <thread>
+
+LatencyModel gLatencyModel{};
+
+namespace {
+    // Time that has been spent in simulated requests when gLatencyModel.sleep is false
+    OSTime sSimulatedTicks = 0;
+    uint32_t sJitterState  = 0x4A495454;
+
+    uint64_t RequestMicroseconds(uint32_t bytes) {
+        uint64_t us = gLatencyModel.baseMicroseconds;
+        if (gLatencyModel.mibPerSecond > 0) {
+            us += (uint64_t) bytes * 1000000 / ((uint64_t) gLatencyModel.mibPerSecond * 1024 * 1024);
+        }
+        if (gLatencyModel.jitterMicroseconds > 0) {
+            sJitterState = sJitterState * 1664525 + 1013904223;
+            us += (sJitterState >> 8) % (gLatencyModel.jitterMicroseconds + 1);
+        }
+        return us;
+    }
+
+    void SimulateRequest(uint32_t bytes) {
+        const auto us = RequestMicroseconds(bytes);
+        if (gLatencyModel.sleep) {
+            std::this_thread::sleep_for(std::chrono::microseconds(us));
+        } else {
+            sSimulatedTicks += OSMicrosecondsToTicks(us);
+        }
+    }
+} // namespace
+
+FSError __FSAShimSend(FSAShimBuffer *shim, uint32_t flags) {
+    (void) flags;
+    switch (shim->command) {
+        case FSA_COMMAND_RAW_OPEN:
+            SimulateRequest(0);
+            shim->response.rawOpen.handle = 1;
+            return FS_ERROR_OK;
+        case FSA_COMMAND_RAW_CLOSE:
+            SimulateRequest(0);
+            return FS_ERROR_OK;
+        case FSA_COMMAND_RAW_READ:
+        case FSA_COMMAND_RAW_WRITE: {
+            const auto &vec     = shim->ioctlvVec[1];
+            const auto &request = shim->request.rawRead;
+            // IOSU only accepts 0x40 aligned buffers, libmocha has to take care of misaligned ones.
+            if ((uintptr_t) vec.vaddr & 0x3F) {
+                OSReport("Misaligned buffer %p passed to IOSU\n", vec.vaddr);
+                return FS_ERROR_INVALID_ALIGNMENT;
+            }
+            if (vec.len != request.size * request.count) {
+                OSReport("Vector length 0x%08X doesn't match %u * %u bytes\n", vec.len, request.count, request.size);
+                return FS_ERROR_INVALID_PARAM;
+            }
+            SimulateRequest(vec.len);
+            return FS_ERROR_OK;
+        }
+        default:
+            return FS_ERROR_INVALID_PARAM;
+    }
+}
+
+FSError __FSAShimDecodeIosErrorToFsaStatus(IOSHandle handle, IOSError error) {
+    (void) handle;
+    return error >= 0 ? FS_ERROR_OK : FS_ERROR_MEDIA_ERROR;
+}
+
+IOSError IOS_IoctlvAsync(IOSHandle handle, uint32_t request, uint32_t vecIn, uint32_t vecOut, IOSVec *vec, IOSAsyncCallbackFn callback, void *context) {
+    (void) handle, (void) request, (void) vecIn, (void) vecOut, (void) vec, (void) callback, (void) context;
+    // The asynchronous requests aren't part of the benchmark
+    return (IOSError) -1;
+}
+
+bool OSSendMessage(OSMessageQueue *queue, OSMessage *message, OSMessageFlags flags) {
+    (void) queue, (void) message, (void) flags;
+    return false;
+}
+
+FSClientBody *FSGetClientBody(FSClient *client) {
+    return reinterpret_cast<FSClientBody *>(client);
+}
+
+OSTime OSGetTime() {
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    return (OSTime) ((unsigned __int128) ns * OSTimerClockSpeed / 1000000000) + sSimulatedTicks;
+}
+
+void OSReport(const char *fmt, ...) {
+    if (!gLatencyModel.verbose) {
+        return;
+    }
+    va_list va;
+    va_start(va, fmt);
+    vfprintf(stderr, fmt, va);
+    va_end(va);
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+struct LatencyModel {
+    //! fixed cost of every request
+    uint32_t baseMicroseconds;
+    //! transfer rate of the simulated device, 0 means infinite
+    uint32_t mibPerSecond;
+    //! a random delay of up to jitterMicroseconds is added to every request
+    uint32_t jitterMicroseconds;
+    //! if true, requests really sleep. Otherwise the time is only added to OSGetTime, which keeps the runs fast.
+    bool sleep;
+    //! print OSReport output of libmocha to stderr
+    bool verbose;
+};
+
+// Used by the stub __FSAShimSend
+extern LatencyModel gLatencyModel;
@@ -0,0 +1,122 @@
+#include "bench.h"
+#include <mocha/fsa.h>
+#include <algorithm>
+#include <coreinit/time.h>
+#include <cstdlib>
+#include <cstring>
+#include <malloc.h>
+#include <new>
+#include <vector>
+
+namespace {
+    const uint32_t sChunkSizes[] = {0x1000, 0x4000, 0x10000, 0x40000, 0x100000};
+
+    // Offset of the buffer to a 0x40 aligned address. Misaligned reads/writes go through the bounce buffer paths.
+    const uint32_t sBufferOffsets[] = {0x0, 0x4, 0x20};
+
+    struct BenchMix {
+        const char *name;
+        //! percentage of calls that are reads
+        uint32_t readPercent;
+    };
+
+    const BenchMix sMixes[] = {
+            {"read", 100},
+            {"r70/w30", 70},
+            {"write", 0},
+    };
+
+    // Deterministic, so every run issues the same sequence of reads and writes.
+    uint32_t NextRandom(uint32_t &state) {
+        state = state * 1664525 + 1013904223;
+        return state >> 8;
+    }
+
+    uint32_t Percentile(const std::vector<uint32_t> &sorted, uint32_t percent) {
+        // nearest rank
+        size_t rank = (sorted.size() * percent + 99) / 100;
+        if (rank == 0) {
+            rank = 1;
+        }
+        return sorted[rank - 1];
+    }
+
+    bool RunOne(const BenchConfig &config, uint8_t *buffer, uint32_t chunkSize, uint32_t bufferOffset, const BenchMix &mix, std::vector<uint32_t> &latencies) {
+        const uint32_t sectorsPerChunk = chunkSize / config.sectorSize;
+        const uint64_t numChunks       = config.numSectors / sectorsPerChunk;
+        uint32_t calls                 = config.bytesPerRun / chunkSize;
+        if (calls < 16) {
+            calls = 16;
+        }
+
+        latencies.clear();
+        uint32_t random  = 0x4D4F4348;
+        uint8_t *data    = buffer + bufferOffset;
+        uint64_t bytes   = 0;
+        const auto start = OSGetTime();
+        for (uint32_t i = 0; i < calls; i++) {
+            const uint64_t sector = config.firstSector + (i % numChunks) * sectorsPerChunk;
+            const bool isRead     = NextRandom(random) % 100 < mix.readPercent;
+
+            const auto callStart = OSGetTime();
+            FSError res;
+            if (isRead) {
+                res = FSAEx_RawReadEx(config.clientHandle, data, config.sectorSize, sectorsPerChunk, sector, config.deviceHandle);
+            } else {
+                res = FSAEx_RawWriteEx(config.clientHandle, data, config.sectorSize, sectorsPerChunk, sector, config.deviceHandle);
+            }
+            latencies.push_back((uint32_t) OSTicksToMicroseconds(OSGetTime() - callStart));
+            if (res < 0) {
+                BenchPrintf("%s of 0x%08X bytes at sector %llu failed: %d\n", isRead ? "Read" : "Write", chunkSize, (unsigned long long) sector, res);
+                return false;
+            }
+            bytes += chunkSize;
+        }
+        const auto elapsedUs = OSTicksToMicroseconds(OSGetTime() - start);
+
+        std::sort(latencies.begin(), latencies.end());
+        const double mibPerSecond = elapsedUs ? (double) bytes / (1024.0 * 1024.0) / ((double) elapsedUs / 1000000.0) : 0.0;
+        BenchPrintf("%7u KiB  +0x%02X  %-8s %6u  %9.2f  %8u  %8u  %8u  %8u\n",
+                    chunkSize / 1024, bufferOffset, mix.name, calls, mibPerSecond,
+                    Percentile(latencies, 50), Percentile(latencies, 90), Percentile(latencies, 99), latencies.back());
+        return true;
+    }
+} // namespace
+
+bool BenchRun(const BenchConfig &config) {
+    const uint32_t maxChunkSize = sChunkSizes[sizeof(sChunkSizes) / sizeof(sChunkSizes[0]) - 1];
+    if (config.sectorSize == 0 || maxChunkSize % config.sectorSize != 0 || config.numSectors < maxChunkSize / config.sectorSize) {
+        BenchPrintf("Invalid config: sector size %u, %llu sectors\n", config.sectorSize, (unsigned long long) config.numSectors);
+        return false;
+    }
+
+    // Leave room for the largest offset
+    auto *buffer = (uint8_t *) memalign(0x40, maxChunkSize + 0x40);
+    if (!buffer) {
+        BenchPrintf("Failed to allocate the transfer buffer\n");
+        return false;
+    }
+    memset(buffer, 0xA5, maxChunkSize + 0x40);
+
+    std::vector<uint32_t> latencies;
+    latencies.reserve(std::max<uint32_t>(config.bytesPerRun / sChunkSizes[0], 16));
+
+    BenchPrintf("%11s  %5s  %-8s %6s  %9s  %8s  %8s  %8s  %8s\n", "chunk", "align", "mix", "calls", "MiB/s", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    bool result = true;
+    for (const auto &mix : sMixes) {
+        if (mix.readPercent < 100 && !config.allowWrites) {
+            BenchPrintf("Skipping \"%s\", writes are disabled\n", mix.name);
+            continue;
+        }
+        for (const auto chunkSize : sChunkSizes) {
+            for (const auto bufferOffset : sBufferOffsets) {
+                if (!RunOne(config, buffer, chunkSize, bufferOffset, mix, latencies)) {
+                    result = false;
+                }
+            }
+        }
+    }
+
+    free(buffer);
+    return result;
+}
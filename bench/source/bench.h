@@ -0,0 +1,34 @@
+#pragma once
+#include <coreinit/filesystem_fsa.h>
+#include <stdint.h>
+
+struct BenchConfig {
+    //! /dev/fsa handle with unlocked permissions
+    FSAClientHandle clientHandle;
+    //! handle returned by FSAEx_RawOpenEx
+    int32_t deviceHandle;
+    //! sector size of the device in bytes
+    uint32_t sectorSize;
+    //! first sector the benchmark may touch
+    uint64_t firstSector;
+    //! number of sectors starting at firstSector the benchmark may touch, transfers wrap around at the end
+    uint64_t numSectors;
+    //! number of bytes that are transferred per chunk size, alignment and mix
+    uint32_t bytesPerRun;
+    //! if false, the read/write and write mixes are skipped
+    bool allowWrites;
+};
+
+/**
+ * Implemented by the console and by the host frontend.
+ */
+void BenchPrintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * Sweeps chunk sizes, buffer alignments and read/write mixes with FSAEx_RawReadEx/FSAEx_RawWriteEx and
+ * prints the throughput and the per-call latency percentiles of each combination.
+ *
+ * @param config
+ * @return false if a transfer failed or a buffer could not be allocated
+ */
+bool BenchRun(const BenchConfig &config);
@@ -0,0 +1,99 @@
+#include "bench.h"
+#include <coreinit/filesystem_fsa.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mocha/fsa.h>
+#include <mocha/mocha.h>
+#include <whb/log.h>
+#include <whb/log_console.h>
+#include <whb/proc.h>
+
+#ifndef BENCH_DEVICE_PATH
+#define BENCH_DEVICE_PATH "/dev/sdcard01"
+#endif
+
+#ifndef BENCH_FIRST_SECTOR
+#define BENCH_FIRST_SECTOR 0
+#endif
+
+// Sectors the benchmark transfers to/from, 64 MiB with 512 byte sectors
+#define BENCH_NUM_SECTORS 0x20000
+
+void BenchPrintf(const char *fmt, ...) {
+    char buffer[256];
+    va_list va;
+    va_start(va, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, va);
+    va_end(va);
+
+    // Every WHBLogPrint is a line of its own
+    const auto len = strlen(buffer);
+    if (len > 0 && buffer[len - 1] == '\n') {
+        buffer[len - 1] = '\0';
+    }
+    WHBLogPrint(buffer);
+    WHBLogConsoleDraw();
+}
+
+static void RunBenchmark() {
+    if (Mocha_InitLibrary() != MOCHA_RESULT_SUCCESS) {
+        BenchPrintf("Mocha_InitLibrary failed, is the MochaPayload running?\n");
+        return;
+    }
+
+    FSAInit();
+    auto clientHandle = FSAAddClient(nullptr);
+    if (clientHandle < 0) {
+        BenchPrintf("FSAAddClient failed: %d\n", clientHandle);
+        Mocha_DeInitLibrary();
+        return;
+    }
+
+    BenchConfig config{};
+    config.clientHandle = clientHandle;
+    config.sectorSize   = 512;
+    config.firstSector  = BENCH_FIRST_SECTOR;
+    config.numSectors   = BENCH_NUM_SECTORS;
+    config.bytesPerRun  = 16 * 1024 * 1024;
+#ifdef BENCH_ALLOW_WRITES
+    config.allowWrites = true;
+#else
+    // Writing random data to the raw device destroys the filesystem on it
+    config.allowWrites = false;
+#endif
+
+    FSError res;
+    if (Mocha_UnlockFSClientEx(clientHandle) != MOCHA_RESULT_SUCCESS) {
+        BenchPrintf("Mocha_UnlockFSClientEx failed\n");
+    } else if ((res = FSAEx_RawOpenEx(clientHandle, BENCH_DEVICE_PATH, &config.deviceHandle)) < 0) {
+        BenchPrintf("FSAEx_RawOpenEx(%s) failed: %s\n", BENCH_DEVICE_PATH, FSAGetStatusStr(res));
+    } else {
+        BenchPrintf("Benchmarking %s, sectors %llu - %llu\n", BENCH_DEVICE_PATH,
+                    (unsigned long long) config.firstSector, (unsigned long long) (config.firstSector + config.numSectors - 1));
+        BenchRun(config);
+        FSAEx_RawCloseEx(clientHandle, config.deviceHandle);
+    }
+
+    FSADelClient(clientHandle);
+    Mocha_DeInitLibrary();
+}
+
+int main(int argc, char **argv) {
+    WHBProcInit();
+    WHBLogConsoleInit();
+
+    RunBenchmark();
+    BenchPrintf("Done, press HOME to exit\n");
+
+    while (WHBProcIsRunning()) {
+        WHBLogConsoleDraw();
+        OSSleepTicks(OSMillisecondsToTicks(100));
+    }
+
+    WHBLogConsoleFree();
+    WHBProcShutdown();
+    return 0;
+}
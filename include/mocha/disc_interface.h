@@ -23,6 +23,7 @@
  ***************************************************************************/
 #pragma once
 
+#include "mocha.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -69,6 +70,161 @@ typedef struct DISC_INTERFACE_STRUCT DISC_INTERFACE;
 extern const DISC_INTERFACE Mocha_sdio_disc_interface;
 extern const DISC_INTERFACE Mocha_usb_disc_interface;
 
+/**
+ * Creates a disc interface for an arbitrary raw device, e.g. "/dev/usb02". <br>
+ * Every created interface uses its own FSA client, raw device handle, cache and readahead,
+ * different interfaces can be used concurrently from different threads. <br>
+ * The returned interface behaves like Mocha_usb_disc_interface and can be used with all Mocha_DiscInterface* functions.
+ * Up to 8 interfaces can exist at the same time.
+ *
+ * @param devicePath path of the raw device that will be opened on startup
+ * @param outInterface will be set to the new disc interface on success
+ * @return MOCHA_RESULT_SUCCESS:             The disc interface has been created<br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT:    devicePath or outInterface is NULL, or the path is too long<br>
+ *         MOCHA_RESULT_MAX_CLIENT:          All disc interfaces are in use
+ */
+MochaUtilsStatus Mocha_DiscInterfaceCreate(const char *devicePath, const DISC_INTERFACE **outInterface);
+
+/**
+ * Shuts down a disc interface that has been created with Mocha_DiscInterfaceCreate and releases it. <br>
+ * The interface must not be used anymore afterwards.
+ *
+ * @param discInterface interface returned by Mocha_DiscInterfaceCreate
+ * @return MOCHA_RESULT_SUCCESS:             The disc interface has been released<br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT:    Unknown disc interface or one of the built-in interfaces<br>
+ *         MOCHA_RESULT_UNKNOWN_ERROR:       Cached writes couldn't be written back, the interface is kept
+ */
+MochaUtilsStatus Mocha_DiscInterfaceDestroy(const DISC_INTERFACE *discInterface);
+
+typedef struct MochaDiscInterfaceGeometry {
+    //! Native sector size of the device in bytes. Sector numbers and counts of the disc interface use this unit.
+    uint32_t sectorSize;
+    //! Size of the device in sectors, 0 if unknown
+    uint64_t numSectors;
+    //! Maximum number of sectors that are sent to the device in one transfer, 0 for no limit
+    uint32_t maxTransferSectors;
+} MochaDiscInterfaceGeometry;
+
+typedef struct MochaDiscInterfaceStats {
+    //! Number of cache blocks that were accessed while already being cached
+    uint32_t cacheHits;
+    //! Number of cache blocks that were accessed without being cached
+    uint32_t cacheMisses;
+    //! Number of dirty cache blocks that have been written to the device
+    uint32_t cacheWriteBacks;
+    //! Number of requests that were too large for the cache and have been sent to the device directly
+    uint32_t cacheBypasses;
+    //! Number of reads that have been (partially) served from prefetched sectors
+    uint32_t readAheadHits;
+    //! Number of asynchronous prefetches that have been issued
+    uint32_t readAheadPrefetches;
+    //! Number of reads that had to wait for a prefetch to finish
+    uint32_t readAheadWaits;
+    //! Number of prefetched windows that have been dropped without being used
+    uint32_t readAheadDiscarded;
+    //! Current size of the readahead window in sectors
+    uint32_t readAheadWindow;
+    //! Number of writes that have been merged into a pending write
+    uint32_t coalescedWrites;
+    //! Number of merged writes that have been sent to the device
+    uint32_t coalescerFlushes;
+    //! Number of raw read requests that have been sent to the device
+    uint32_t rawReads;
+    //! Number of raw write requests that have been sent to the device
+    uint32_t rawWrites;
+} MochaDiscInterfaceStats;
+
+/**
+ * Configures the sector cache of a disc interface. The cache is disabled by default. <br>
+ * Small reads and writes are served from blocks of sectorsPerBlock sectors, which are evicted in LRU order.
+ * In write-back mode, modified blocks are written to the device on eviction, clearStatus and shutdown. <br>
+ * If that fails, shutdown returns false and keeps the device open with the modified blocks, so it can be retried. <br>
+ * Calling this function writes back all dirty blocks of the current cache.
+ *
+ * @param discInterface Mocha_sdio_disc_interface, Mocha_usb_disc_interface or an interface created with Mocha_DiscInterfaceCreate
+ * @param numBlocks number of blocks that will be cached. 0 disables the cache.
+ * @param sectorsPerBlock number of sectors per block, e.g. 8
+ * @param writeBack true to keep modified blocks in the cache, false to write them through immediately.
+ * @return MOCHA_RESULT_SUCCESS:             The cache has been configured<br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT:    Unknown disc interface, more than 65536 blocks or more than 64 MiB of cached data<br>
+ *         MOCHA_RESULT_OUT_OF_MEMORY:       Failed to allocate the cache<br>
+ *         MOCHA_RESULT_UNKNOWN_ERROR:       Failed to write back the existing cache
+ */
+MochaUtilsStatus Mocha_DiscInterfaceSetCacheSize(const DISC_INTERFACE *discInterface, uint32_t numBlocks, uint32_t sectorsPerBlock, bool writeBack);
+
+/**
+ * Configures the sequential readahead of a disc interface. The readahead is disabled by default. <br>
+ * Once sequential reads are detected, the following sectors are read into aligned buffers and the next
+ * window is already requested in the background while the current one is consumed.
+ * The window starts at minSectors and doubles with every used window up to maxSectors. <br>
+ * Allocates two buffers of maxSectors sectors.
+ *
+ * @param discInterface Mocha_sdio_disc_interface, Mocha_usb_disc_interface or an interface created with Mocha_DiscInterfaceCreate
+ * @param minSectors initial size of the readahead window in sectors, e.g. 64
+ * @param maxSectors maximum size of the readahead window in sectors, e.g. 2048. 0 disables the readahead.
+ * @return MOCHA_RESULT_SUCCESS:             The readahead has been configured<br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT:    Unknown disc interface, minSectors is larger than maxSectors or maxSectors sectors exceed 64 MiB<br>
+ *         MOCHA_RESULT_OUT_OF_MEMORY:       Failed to allocate the readahead buffers
+ */
+MochaUtilsStatus Mocha_DiscInterfaceSetReadAhead(const DISC_INTERFACE *discInterface, uint32_t minSectors, uint32_t maxSectors);
+
+/**
+ * Configures the write coalescing of a disc interface. The coalescing is disabled by default. <br>
+ * Contiguous and overlapping writes are collected and sent to the device as one large write once maxSectors
+ * have been collected, a write doesn't continue the pending range, a read touches it, or on clearStatus/shutdown. <br>
+ * Until then the data only lives in memory, call Mocha_DiscInterfaceFlush to make sure it's on the device.
+ *
+ * @param discInterface Mocha_sdio_disc_interface, Mocha_usb_disc_interface or an interface created with Mocha_DiscInterfaceCreate
+ * @param maxSectors maximum size of a merged write in sectors, e.g. 256. 0 disables the coalescing.
+ * @return MOCHA_RESULT_SUCCESS:             The write coalescing has been configured<br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT:    Unknown disc interface or maxSectors sectors exceed 64 MiB<br>
+ *         MOCHA_RESULT_OUT_OF_MEMORY:       Failed to allocate the buffer or to write pending sectors
+ */
+MochaUtilsStatus Mocha_DiscInterfaceSetWriteCoalescing(const DISC_INTERFACE *discInterface, uint32_t maxSectors);
+
+/**
+ * Returns the geometry of the device behind a disc interface. It's queried when the device is opened in startup(),
+ * if that fails a sector size of 512 bytes is assumed.
+ *
+ * @param discInterface Mocha_sdio_disc_interface, Mocha_usb_disc_interface or an interface created with Mocha_DiscInterfaceCreate
+ * @param outGeometry will be filled with the geometry of the device
+ * @return MOCHA_RESULT_SUCCESS:             The geometry has been returned<br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT:    Unknown disc interface or outGeometry is NULL<br>
+ *         MOCHA_RESULT_NOT_FOUND:           The device hasn't been opened via startup() yet
+ */
+MochaUtilsStatus Mocha_DiscInterfaceGetGeometry(const DISC_INTERFACE *discInterface, MochaDiscInterfaceGeometry *outGeometry);
+
+/**
+ * Limits the number of sectors that are sent to the device in one transfer, larger requests are split. <br>
+ * To merge small writes into larger transfers, see Mocha_DiscInterfaceSetWriteCoalescing.
+ *
+ * @param discInterface Mocha_sdio_disc_interface, Mocha_usb_disc_interface or an interface created with Mocha_DiscInterfaceCreate
+ * @param maxSectors maximum number of sectors per transfer, 0 for no limit (default)
+ * @return MOCHA_RESULT_SUCCESS:             The limit has been set<br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT:    Unknown disc interface
+ */
+MochaUtilsStatus Mocha_DiscInterfaceSetMaxTransferSize(const DISC_INTERFACE *discInterface, uint32_t maxSectors);
+
+/**
+ * Writes all modified sectors of a disc interface to the device. Same as calling discInterface->clearStatus().
+ *
+ * @param discInterface Mocha_sdio_disc_interface, Mocha_usb_disc_interface or an interface created with Mocha_DiscInterfaceCreate
+ * @return MOCHA_RESULT_SUCCESS:             All modified sectors have been written<br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT:    Unknown disc interface<br>
+ *         MOCHA_RESULT_UNKNOWN_ERROR:       Failed to write to the device
+ */
+MochaUtilsStatus Mocha_DiscInterfaceFlush(const DISC_INTERFACE *discInterface);
+
+/**
+ * Retrieves the I/O statistics of a disc interface.
+ *
+ * @param discInterface Mocha_sdio_disc_interface, Mocha_usb_disc_interface or an interface created with Mocha_DiscInterfaceCreate
+ * @param outStats pointer where the statistics will be stored
+ * @return MOCHA_RESULT_SUCCESS:             The statistics have been stored in outStats<br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT:    Unknown disc interface or outStats was NULL
+ */
+MochaUtilsStatus Mocha_DiscInterfaceGetStats(const DISC_INTERFACE *discInterface, MochaDiscInterfaceStats *outStats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -2,12 +2,86 @@
 
 #include <coreinit/filesystem.h>
 #include <coreinit/filesystem_fsa.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/thread.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct FSAExShimPoolStats {
+    //! Number of requests that have been served by a pooled FSAShimBuffer
+    uint32_t poolHits;
+    //! Number of requests that had to allocate a FSAShimBuffer because the pool was exhausted
+    uint32_t poolMisses;
+    //! Number of pool hits where the buffer was already set up for the same client handle and command
+    uint32_t templateHits;
+    //! Number of pooled buffers that are currently in use
+    uint32_t inUse;
+    //! Total number of pooled buffers
+    uint32_t capacity;
+} FSAExShimPoolStats;
+
+/**
+ * Callback for asynchronous raw reads/writes.
+ * @param clientHandle /dev/fsa handle the request was sent to
+ * @param data buffer that was passed to FSAEx_RawReadAsync/FSAEx_RawWriteAsync
+ * @param result result of the request
+ * @param param user defined param of the FSAExAsyncData
+ */
+typedef void (*FSAExAsyncCallbackFn)(FSAClientHandle clientHandle, void *data, FSError result, void *param);
+
+typedef struct FSAExAsyncData {
+    //! (optional) Callback that is called when the completion message is handled via FSAEx_RawAsyncHandleMessage
+    FSAExAsyncCallbackFn callback;
+    //! (optional) Param that is passed to the callback
+    void *param;
+    //! Queue the completion message is sent to. Must have room for all requests that are in flight, submitting
+    //! more requests than the queue has messages fails with FS_ERROR_OUT_OF_RESOURCES.
+    OSMessageQueue *ioMsgQueue;
+} FSAExAsyncData;
+
+/**
+ * Consumer of FSAEx_RawImage, called for every chunk in order on the consumer thread.
+ * @param data aligned buffer with the sectors that have been read. Only valid until the consumer returns.
+ * @param size size of the chunk in bytes
+ * @param offset offset of the chunk in bytes, relative to the start of the device
+ * @param userData user defined data of the FSAExRawImageParams
+ * @return FS_ERROR_OK to continue, a negative value aborts the imaging
+ */
+typedef FSError (*FSAExRawImageConsumerFn)(const void *data, uint32_t size, uint64_t offset, void *userData);
+
+/**
+ * Progress callback of FSAEx_RawImage, called on the thread that called FSAEx_RawImage.
+ * @param bytesDone number of bytes that have been handled by the consumer
+ * @param bytesTotal total number of bytes that will be imaged
+ * @param bytesPerSecond average throughput since the start
+ * @param userData user defined data of the FSAExRawImageParams
+ */
+typedef void (*FSAExRawImageProgressFn)(uint64_t bytesDone, uint64_t bytesTotal, uint64_t bytesPerSecond, void *userData);
+
+typedef struct FSAExRawImageParams {
+    //! Size of a sector in bytes
+    uint32_t sectorSize;
+    //! First sector that will be read
+    uint64_t startSector;
+    //! Number of sectors that will be read
+    uint64_t numSectors;
+    //! Number of sectors that are read at once. Every buffer has a size of sectorsPerChunk * sectorSize
+    uint32_t sectorsPerChunk;
+    //! Number of buffers (2 - 8). 0 uses triple buffering
+    uint32_t numBuffers;
+    //! Core(s) the consumer runs on. 0 uses a core that is different from the current one
+    OSThreadAttributes consumerAffinity;
+    //! Called for every chunk that has been read
+    FSAExRawImageConsumerFn consumer;
+    //! (optional) Called regularly while the consumer makes progress and once at the end
+    FSAExRawImageProgressFn progress;
+    //! (optional) Passed to the consumer and progress callbacks
+    void *userData;
+} FSAExRawImageParams;
+
 /**
  * Opens a device for raw read/write
  * @param client valid FSClient pointer with unlocked permissions
@@ -95,6 +169,82 @@ FSError FSAEx_RawWrite(FSClient *client, const void *data, uint32_t size_bytes,
  */
 FSError FSAEx_RawWriteEx(FSAClientHandle clientHandle, const void *data, uint32_t size_bytes, uint32_t cnt, uint64_t blocks_offset, int device_handle);
 
+/**
+ * Submits a raw read and returns without waiting for the result. <br>
+ * When the request has been processed by IOSU, an OSMessage is sent to asyncData->ioMsgQueue.
+ * Pass that message to FSAEx_RawAsyncHandleMessage to finish the request. <br>
+ * The data buffer must stay valid until the request has been finished.
+ *
+ * @param clientHandle valid /dev/fsa handle with unlocked permissions
+ * @param data buffer where the result will be stored. Should be 0x40 aligned. Misaligned buffers are only
+ *             supported for requests of up to 128 KiB, larger ones fail with FS_ERROR_INVALID_ALIGNMENT.
+ * @param size_bytes size of sector.
+ * @param cnt number of sectors that should be read.
+ * @param blocks_offset read offset in sectors.
+ * @param device_handle valid device handle.
+ * @param asyncData describes how the completion will be reported.
+ * @return FS_ERROR_OK if the request has been submitted. <br>
+ *         FS_ERROR_OUT_OF_RESOURCES if asyncData->ioMsgQueue has no room for another completion message.
+ */
+FSError FSAEx_RawReadAsync(FSAClientHandle clientHandle, void *data, uint32_t size_bytes, uint32_t cnt, uint64_t blocks_offset, int device_handle, const FSAExAsyncData *asyncData);
+
+/**
+ * Submits a raw write and returns without waiting for the result. <br>
+ * When the request has been processed by IOSU, an OSMessage is sent to asyncData->ioMsgQueue.
+ * Pass that message to FSAEx_RawAsyncHandleMessage to finish the request. <br>
+ * The data buffer must stay valid until the request has been finished.
+ *
+ * @param clientHandle valid /dev/fsa handle with unlocked permissions
+ * @param data buffer of data that should be written. Should be 0x40 aligned. Misaligned buffers are only
+ *             supported for requests of up to 128 KiB, larger ones fail with FS_ERROR_INVALID_ALIGNMENT.
+ * @param size_bytes size of sector.
+ * @param cnt number of sectors that should be written.
+ * @param blocks_offset write offset in sectors.
+ * @param device_handle valid device handle.
+ * @param asyncData describes how the completion will be reported.
+ * @return FS_ERROR_OK if the request has been submitted. <br>
+ *         FS_ERROR_OUT_OF_RESOURCES if asyncData->ioMsgQueue has no room for another completion message.
+ */
+FSError FSAEx_RawWriteAsync(FSAClientHandle clientHandle, const void *data, uint32_t size_bytes, uint32_t cnt, uint64_t blocks_offset, int device_handle, const FSAExAsyncData *asyncData);
+
+/**
+ * Finishes an asynchronous raw request. Must be called for every completion message that has been
+ * received from the ioMsgQueue of a FSAEx_RawReadAsync/FSAEx_RawWriteAsync request. <br>
+ * Copies the data back into the callers buffer (if needed), calls the callback of the request on the
+ * current thread and frees all resources of the request.
+ *
+ * @param message message that has been received from the ioMsgQueue
+ * @param outParam (optional) pointer where the param of the FSAExAsyncData will be stored
+ * @return result of the raw read/write or FS_ERROR_INVALID_PARAM if the message does not belong to a raw request.
+ */
+FSError FSAEx_RawAsyncHandleMessage(OSMessage *message, void **outParam);
+
+/**
+ * Reads a range of sectors from a raw device and passes them chunk by chunk to a consumer (e.g. hashing or writing to a file). <br>
+ * The sectors are read into multiple aligned buffers on the current thread while the consumer processes the
+ * previously read chunks on a separate thread, so reading only stalls when the consumer is behind by all buffers. <br>
+ * Blocks until all sectors have been consumed or an error occurred.
+ *
+ * @param clientHandle valid /dev/fsa handle with unlocked permissions
+ * @param device_handle valid device handle.
+ * @param params describes the range, buffering and callbacks.
+ * @return FS_ERROR_OK on success, the error of the failed read, the error returned by the consumer,
+ *         FS_ERROR_INVALID_PARAM for invalid params or FS_ERROR_OUT_OF_RESOURCES if the buffers or thread couldn't be allocated.
+ */
+FSError FSAEx_RawImage(FSAClientHandle clientHandle, int device_handle, const FSAExRawImageParams *params);
+
+/**
+ * Retrieves the statistics of the FSAShimBuffer pool that is used by the FSAEx_Raw* functions.
+ *
+ * @param outStats pointer where the statistics will be stored.
+ */
+void FSAEx_GetShimPoolStats(FSAExShimPoolStats *outStats);
+
+/**
+ * Resets the hit/miss counters of the FSAShimBuffer pool.
+ */
+void FSAEx_ResetShimPoolStats();
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
\ No newline at end of file
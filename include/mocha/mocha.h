@@ -4,6 +4,7 @@
 #include <coreinit/filesystem.h>
 #include <coreinit/filesystem_fsa.h>
 #include <stdint.h>
+#include <sys/types.h>
 #include <sysapp/args.h>
 
 #ifdef __cplusplus
@@ -322,6 +323,245 @@ MochaUtilsStatus Mocha_MountFS(const char *virt_name, const char *dev_path, cons
 
 MochaUtilsStatus Mocha_MountFSEx(const char *virt_name, const char *dev_path, const char *mount_path, FSAMountFlags mountFlags, void *mountArgBuf, int mountArgBufLen);
 
+/**
+ * I/O tuning of a mount, see Mocha_MountFSWithProfile. <br>
+ * All sizes are rounded down to a multiple of 0x40, fields that are 0 use the default value.
+ */
+typedef struct MochaFSIOProfile {
+    //! Maximum size of a single read request in bytes. Default: 1 MiB
+    uint32_t readChunkSize;
+    //! Maximum size of a single write request in bytes. Default: 256 KiB
+    uint32_t writeChunkSize;
+    //! Number of requests that are kept in flight for transfers larger than a chunk (max. 8). 1 disables the pipelining. Default: 3
+    uint32_t inFlightDepth;
+    //! Transfers with a buffer or size that is not a multiple of 0x40 and up to this size are done with a single request
+    //! through a temporary aligned buffer, instead of splitting off the unaligned parts into separate requests. Default: 0 (disabled)
+    uint32_t bounceBufferSize;
+    //! See Mocha_MountFSSetReadAheadSize. Default: 0 (disabled)
+    uint32_t readAheadSize;
+    //! See Mocha_MountFSSetWriteBufferSize. Default: 0 (disabled)
+    uint32_t writeBufferSize;
+    //! See Mocha_MountFSSetMaxClients. Default: 1
+    uint32_t maxClients;
+    //! Always ask the filesystem for the size and stat of open files (fstat, SEEK_END) instead of using the values that are
+    //! cached in the file, e.g. if the files are modified by other processes while they are open. Files opened with O_SYNC are never cached.
+    bool uncachedFileStat;
+    //! See Mocha_MountFSSetMetadataCache. Default: 0 (disabled)
+    uint32_t metadataCacheEntries;
+    //! See Mocha_MountFSSetMetadataCache
+    uint32_t metadataCacheTTL;
+    //! See Mocha_MountFSSetHandleCache, values above 32 are clamped. Default: 0 (disabled)
+    uint32_t cachedHandles;
+    //! See Mocha_MountFSSetMaxOpenFiles. Default: 0 (disabled)
+    uint32_t maxOpenFiles;
+    //! Measure the throughput of different chunk sizes while mounting and use the fastest ones instead of readChunkSize and writeChunkSize.
+    //! Writes and deletes a temporary file of 2 MiB in the root of the mount, takes about a second. Keeps the given chunk sizes if the mount is read-only.
+    bool calibrate;
+} MochaFSIOProfile;
+
+/**
+ * Same as Mocha_MountFSEx, but uses the given I/O profile for the files of the mount.
+ *
+ * @param profile (optional) I/O profile of the mount, NULL uses the default values.
+ * @return see Mocha_MountFS
+ */
+MochaUtilsStatus Mocha_MountFSWithProfile(const char *virt_name, const char *dev_path, const char *mount_path, FSAMountFlags mountFlags, void *mountArgBuf, int mountArgBufLen,
+                                          const MochaFSIOProfile *profile);
+
+/**
+ * Returns the I/O profile that is used by a mount, e.g. to get the chunk sizes that have been picked by the calibration.
+ *
+ * @param virt_name Name of the mount.
+ * @param outProfile Target buffer where the profile will be stored. calibrate is always false.
+ * @return MOCHA_RESULT_SUCCESS: The profile has been stored in outProfile <br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT: virt_name or outProfile was NULL <br>
+ *         MOCHA_RESULT_NOT_FOUND: No mount with the given name has been found.
+ */
+MochaUtilsStatus Mocha_MountFSGetIOProfile(const char *virt_name, MochaFSIOProfile *outProfile);
+
+/**
+ * Sets the size of the readahead buffer that is used for files of a mount. <br>
+ * Reads that are smaller than the buffer are served from it, the buffer is filled with a single large read.
+ * This avoids one request to the filesystem per small read, e.g. when parsing a file a few bytes at a time. <br>
+ * Only affects files that are opened afterwards. Changes made to the file through other handles may not be visible
+ * until data outside the buffer is read.
+ *
+ * @param virt_name Name of the mount.
+ * @param size Size of the buffer in bytes, will be rounded up to a multiple of 0x40. 0 disables the readahead (default).
+ * @return MOCHA_RESULT_SUCCESS: The readahead size has been set <br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT: virt_name was NULL <br>
+ *         MOCHA_RESULT_NOT_FOUND: No mount with the given name has been found.
+ */
+MochaUtilsStatus Mocha_MountFSSetReadAheadSize(const char *virt_name, uint32_t size);
+
+/**
+ * Sets the size of the write-behind buffer that is used for files of a mount. <br>
+ * Writes that are smaller than the buffer are collected and written as one large chunk once the buffer is full,
+ * or on the next read, seek, fstat, ftruncate, fsync or close of the file. Files opened with O_SYNC are not buffered. <br>
+ * Only affects files that are opened afterwards. Errors of delayed writes are reported by the operation that
+ * wrote the buffer, e.g. fsync or close.
+ *
+ * @param virt_name Name of the mount.
+ * @param size Size of the buffer in bytes, will be rounded up to a multiple of 0x40. 0 disables the buffer (default).
+ * @return MOCHA_RESULT_SUCCESS: The buffer size has been set <br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT: virt_name was NULL <br>
+ *         MOCHA_RESULT_NOT_FOUND: No mount with the given name has been found.
+ */
+MochaUtilsStatus Mocha_MountFSSetWriteBufferSize(const char *virt_name, uint32_t size);
+
+/**
+ * Enables a cache for the metadata of the paths of a mount. <br>
+ * stat, the existence checks of open and opendir of paths that have been looked up before (including paths that
+ * don't exist) are answered from the cache instead of the filesystem. Entries are dropped when they are changed through
+ * the same mount (write, ftruncate, unlink, rename, mkdir, rmdir, chmod, opening a file for writing).
+ * Changes made by other processes or through other mounts are only visible once the entry has expired. <br>
+ * Listing a directory with readdir adds the stat of every entry to the cache, so a stat of the listed entries
+ * doesn't need a request per entry.
+ *
+ * @param virt_name Name of the mount.
+ * @param maxEntries Maximum number of cached paths, the least recently used path is dropped when the cache is full. 0 disables the cache (default).
+ *                   All entries are allocated up front, every entry takes about 0.75 KiB.
+ * @param ttlMs Time in milliseconds after which an entry expires.
+ * @return MOCHA_RESULT_SUCCESS: The cache has been configured <br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT: virt_name was NULL <br>
+ *         MOCHA_RESULT_OUT_OF_MEMORY: Failed to allocate the cache <br>
+ *         MOCHA_RESULT_NOT_FOUND: No mount with the given name has been found.
+ */
+MochaUtilsStatus Mocha_MountFSSetMetadataCache(const char *virt_name, uint32_t maxEntries, uint32_t ttlMs);
+
+/**
+ * Enables a cache of the handles of read-only files of a mount. <br>
+ * Files that have been opened read-only (without O_UNENCRYPTED) stay open on the filesystem when they are closed,
+ * the next open of the same path reuses the handle instead of opening the file again.
+ * Cached handles are closed when the file is changed through the same mount (write, ftruncate, unlink, rename,
+ * rmdir, opening it for writing), and the least recently closed handle is closed when the cache is full.
+ * Cached handles count towards the open file limit of the filesystem.
+ *
+ * @param virt_name Name of the mount.
+ * @param maxHandles Maximum number of handles that are kept open, at most 32. 0 disables the cache and closes all cached handles (default).
+ * @return MOCHA_RESULT_SUCCESS: The cache has been configured <br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT: virt_name was NULL or maxHandles was too large <br>
+ *         MOCHA_RESULT_OUT_OF_MEMORY: Failed to allocate the cache <br>
+ *         MOCHA_RESULT_NOT_FOUND: No mount with the given name has been found.
+ */
+MochaUtilsStatus Mocha_MountFSSetHandleCache(const char *virt_name, uint32_t maxHandles);
+
+/**
+ * Virtualizes the handles of the files that are opened on a mount from now on. <br>
+ * The files only keep up to maxOpenFiles FSA handles open. When another one is needed, the handle of the least recently
+ * used idle file is closed, and reopened the next time that file is accessed. Its offset, flags and buffers are kept.
+ * That way more files can be open than IOSU supports at the same time. When IOSU runs out of handles anyway,
+ * the cached handles (see Mocha_MountFSSetHandleCache) and the handle of an idle file are closed, and the open is retried. <br>
+ * The limit can be exceeded for a short time while all files are in use. If a file is removed by another process
+ * while its handle is closed, the next access fails (files opened with O_APPEND are created again).
+ *
+ * @param virt_name Name of the mount.
+ * @param maxOpenFiles Maximum number of FSA handles for the files of the mount. 0 disables the virtualization (default).
+ * @return MOCHA_RESULT_SUCCESS: The limit has been set <br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT: virt_name was NULL <br>
+ *         MOCHA_RESULT_NOT_FOUND: No mount with the given name has been found.
+ */
+MochaUtilsStatus Mocha_MountFSSetMaxOpenFiles(const char *virt_name, uint32_t maxOpenFiles);
+
+/**
+ * Sets the maximum number of FSA clients that are used for a mount. <br>
+ * Every client handles one request at a time. Additional clients are created when a file or directory is opened
+ * or a path is accessed while all existing clients are in use. Open files and directories stay on the client they have
+ * been opened with, so threads working on different files don't have to wait for each other.
+ * Clients are only freed on unmount.
+ *
+ * @param virt_name Name of the mount.
+ * @param maxClients Maximum number of clients, between 1 (default) and 8.
+ * @return MOCHA_RESULT_SUCCESS: The maximum has been set <br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT: virt_name was NULL or maxClients was out of range <br>
+ *         MOCHA_RESULT_NOT_FOUND: No mount with the given name has been found.
+ */
+MochaUtilsStatus Mocha_MountFSSetMaxClients(const char *virt_name, uint32_t maxClients);
+
+#ifndef O_PREALLOCATE
+/**
+ * Extended open() flag for files on a mount created by Mocha_MountFS, see Mocha_MountFSSetPreallocationHint.
+ */
+#define O_PREALLOCATE 0x8000000
+#endif
+
+/**
+ * Sets the size that is preallocated for files that are opened with O_PREALLOCATE for writing on a mount. <br>
+ * The filesystem reserves the space when the file is created, which avoids growing the file in small steps when
+ * large files are written in chunks. The size of the file doesn't change. Files opened without O_PREALLOCATE are not affected.
+ *
+ * @param virt_name Name of the mount.
+ * @param size Number of bytes to preallocate, 0 disables the preallocation (default).
+ * @return MOCHA_RESULT_SUCCESS: The size has been set <br>
+ *         MOCHA_RESULT_INVALID_ARGUMENT: virt_name was NULL <br>
+ *         MOCHA_RESULT_NOT_FOUND: No mount with the given name has been found.
+ */
+MochaUtilsStatus Mocha_MountFSSetPreallocationHint(const char *virt_name, uint32_t size);
+
+/**
+ * Buffer of a vectored read or write, see Mocha_FSPReadV and Mocha_FSPWriteV.
+ */
+typedef struct MochaFSIOVec {
+    void *base;
+    size_t len;
+} MochaFSIOVec;
+
+/**
+ * Reads up to count bytes at the given offset of a file on a mount created by Mocha_MountFS, like pread. <br>
+ * The offset of the file is neither used nor changed, so multiple threads can read different parts of
+ * the same file at the same time.
+ *
+ * @param fd File descriptor of a file opened on a Mocha mount (e.g. from open or fileno).
+ * @param buf Target buffer, using a 0x40 aligned buffer avoids additional requests.
+ * @param count Number of bytes to read.
+ * @param offset Offset in the file to read from.
+ * @return Number of bytes that have been read, 0 at the end of the file. -1 on error with errno set: <br>
+ *         EBADF: fd is invalid or not open for reading <br>
+ *         EINVAL: The offset is invalid or fd doesn't belong to a Mocha mount.
+ */
+ssize_t Mocha_FSPRead(int fd, void *buf, size_t count, off_t offset);
+
+/**
+ * Writes count bytes at the given offset of a file on a mount created by Mocha_MountFS, like pwrite. <br>
+ * The offset of the file is neither used nor changed. <br>
+ * Files opened with O_APPEND are not supported, FSA would append the data instead of writing it at the offset.
+ *
+ * @return Number of bytes that have been written. -1 on error with errno set: <br>
+ *         EBADF: fd is invalid or not open for writing <br>
+ *         EINVAL: The offset is invalid, fd has been opened with O_APPEND or doesn't belong to a Mocha mount.
+ */
+ssize_t Mocha_FSPWrite(int fd, const void *buf, size_t count, off_t offset);
+
+/**
+ * Same as Mocha_FSPRead, but scatters the data into multiple buffers, like preadv. <br>
+ * The data is read into a temporary aligned buffer in chunks of up to the read chunk size of the mount,
+ * instead of with one transfer per buffer.
+ */
+ssize_t Mocha_FSPReadV(int fd, const MochaFSIOVec *iov, int iovcnt, off_t offset);
+
+/**
+ * Same as Mocha_FSPWrite, but gathers the data from multiple buffers, like pwritev. <br>
+ * The data is collected in a temporary aligned buffer in chunks of up to the write chunk size of the mount,
+ * instead of writing it with one transfer per buffer.
+ */
+ssize_t Mocha_FSPWriteV(int fd, const MochaFSIOVec *iov, int iovcnt, off_t offset);
+
+/**
+ * Makes sure that a file on a mount created by Mocha_MountFS is at least offset + len bytes large, like posix_fallocate. <br>
+ * FSA has no way to allocate space without writing it, so the file is extended with zeros. Existing data is never changed.
+ * The offset of the file is neither used nor changed.
+ *
+ * @param fd File descriptor of a file opened for writing on a Mocha mount.
+ * @param offset Start of the range that should be allocated.
+ * @param len Length of the range that should be allocated.
+ * @return 0 on success, otherwise an error number (errno is not set): <br>
+ *         EBADF: fd is invalid or not open for writing <br>
+ *         EINVAL: offset or len is invalid or fd doesn't belong to a Mocha mount <br>
+ *         EFBIG: offset + len is larger than the maximum file size <br>
+ *         ENOSPC: There is not enough space left.
+ */
+int Mocha_FSPAllocate(int fd, off_t offset, off_t len);
+
 /**
  * Unmounts a mount by it's name.
  * @param virt_name Name of the mount.
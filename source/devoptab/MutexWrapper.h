@@ -15,6 +15,10 @@ public:
         OSLockMutex(&mutex);
     }
 
+    bool try_lock() {
+        return OSTryLockMutex(&mutex);
+    }
+
     void unlock() {
         OSUnlockMutex(&mutex);
         OSMemoryBarrier();
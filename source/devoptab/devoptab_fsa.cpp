@@ -6,9 +6,12 @@
 #include <complex>
 #include <coreinit/cache.h>
 #include <coreinit/filesystem_fsa.h>
+#include <coreinit/time.h>
 #include <mutex>
 #include <string>
 
+#define FSA_CALIBRATION_SIZE 0x200000
+
 static const devoptab_t fsa_default_devoptab = {
         .structSize   = sizeof(__fsa_file_t),
         .open_r       = __fsa_open,
@@ -44,19 +47,40 @@ static FSADeviceData fsa_mounts[0x10];
 static void fsaResetMount(FSADeviceData *mount, const uint32_t id) {
     *mount = {};
     memcpy(&mount->device, &fsa_default_devoptab, sizeof(fsa_default_devoptab));
-    mount->device.name         = mount->name;
-    mount->device.deviceData   = mount;
-    mount->id                  = id;
-    mount->setup               = false;
-    mount->mounted             = false;
-    mount->isSDCard            = false;
-    mount->clientHandle        = -1;
-    mount->deviceSizeInSectors = 0;
-    mount->deviceSectorSize    = 0;
-    mount->cwd[0]              = '/';
-    mount->cwd[1]              = '\0';
+    mount->device.name          = mount->name;
+    mount->device.deviceData    = mount;
+    mount->id                   = id;
+    mount->setup                = false;
+    mount->mounted              = false;
+    mount->isSDCard             = false;
+    mount->clientHandle         = -1;
+    mount->deviceSizeInSectors  = 0;
+    mount->deviceSectorSize     = 0;
+    mount->readAheadSize        = 0;
+    mount->writeBufferSize      = 0;
+    mount->readChunkSize        = FSA_DEFAULT_READ_CHUNK_SIZE;
+    mount->writeChunkSize       = FSA_DEFAULT_WRITE_CHUNK_SIZE;
+    mount->pipelineDepth        = FSA_DEFAULT_PIPELINE_DEPTH;
+    mount->bounceBufferSize     = 0;
+    mount->maxClients           = 1;
+    mount->numClients           = 0;
+    mount->cacheFileStat        = true;
+    mount->metadataCache        = nullptr;
+    mount->metadataCacheEntries = 0;
+    mount->metadataCacheTTL     = 0;
+    mount->preallocSize         = 0;
+    mount->handleCache          = nullptr;
+    mount->maxCachedHandles     = 0;
+    mount->maxOpenFiles         = 0;
+    mount->numOpenFiles         = 0;
+    mount->openFilesHead        = nullptr;
+    mount->openFilesTail        = nullptr;
+    mount->cwd[0]               = '/';
+    mount->cwd[1]               = '\0';
     memset(mount->mountPath, 0, sizeof(mount->mountPath));
     memset(mount->name, 0, sizeof(mount->name));
+    mount->clientMutex.init("fsa client pool");
+    mount->openFilesMutex.init("fsa open files");
     DCFlushRange(mount, sizeof(*mount));
 }
 
@@ -84,13 +108,33 @@ FSADeviceData *fsa_alloc() {
     return nullptr;
 }
 
+// Calls func with the mount called virt_name while fsaMutex is held, returns MOCHA_RESULT_NOT_FOUND if there is no such mount.
+template<typename Func>
+static MochaUtilsStatus fsaWithMount(const char *virt_name, Func &&func) {
+    std::lock_guard lock(fsaMutex);
+
+    fsaInit();
+
+    for (auto &fsa_mount : fsa_mounts) {
+        FSADeviceData *mount = &fsa_mount;
+        if (mount->setup && strcmp(mount->name, virt_name) == 0) {
+            return func(mount);
+        }
+    }
+
+    return MOCHA_RESULT_NOT_FOUND;
+}
+
 static void fsa_free(FSADeviceData *mount) {
     FSError res;
+    __fsa_handle_cache_free(mount);
     if (mount->mounted) {
         if ((res = FSAUnmount(mount->clientHandle, mount->mountPath, FSA_UNMOUNT_FLAG_FORCE)) < 0) {
             DEBUG_FUNCTION_LINE_WARN("FSAUnmount %s for %s failed: %s", mount->mountPath, mount->name, FSAGetStatusStr(res));
         }
     }
+    __fsa_free_clients(mount);
+    __fsa_metadata_cache_free(mount);
     res = FSADelClient(mount->clientHandle);
     if (res < 0) {
         DEBUG_FUNCTION_LINE_WARN("FSADelClient for %s failed: %s", mount->name, FSAGetStatusStr(res));
@@ -122,6 +166,217 @@ MochaUtilsStatus Mocha_UnmountFS(const char *virt_name) {
     DEBUG_FUNCTION_LINE_WARN("Failed to find fsa mount data for %s", virt_name);
     return MOCHA_RESULT_NOT_FOUND;
 }
+MochaUtilsStatus Mocha_MountFSSetReadAheadSize(const char *virt_name, uint32_t size) {
+    if (!virt_name) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    return fsaWithMount(virt_name, [&](FSADeviceData *mount) {
+        mount->readAheadSize = size;
+        return MOCHA_RESULT_SUCCESS;
+    });
+}
+
+MochaUtilsStatus Mocha_MountFSSetWriteBufferSize(const char *virt_name, uint32_t size) {
+    if (!virt_name) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    return fsaWithMount(virt_name, [&](FSADeviceData *mount) {
+        mount->writeBufferSize = size;
+        return MOCHA_RESULT_SUCCESS;
+    });
+}
+
+MochaUtilsStatus Mocha_MountFSGetIOProfile(const char *virt_name, MochaFSIOProfile *outProfile) {
+    if (!virt_name || !outProfile) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    return fsaWithMount(virt_name, [&](FSADeviceData *mount) {
+        *outProfile                      = {};
+        outProfile->readChunkSize        = mount->readChunkSize;
+        outProfile->writeChunkSize       = mount->writeChunkSize;
+        outProfile->inFlightDepth        = mount->pipelineDepth;
+        outProfile->bounceBufferSize     = mount->bounceBufferSize;
+        outProfile->readAheadSize        = mount->readAheadSize;
+        outProfile->writeBufferSize      = mount->writeBufferSize;
+        outProfile->maxClients           = mount->maxClients;
+        outProfile->uncachedFileStat     = !mount->cacheFileStat;
+        outProfile->metadataCacheEntries = mount->metadataCacheEntries;
+        outProfile->metadataCacheTTL     = mount->metadataCacheTTL;
+        outProfile->cachedHandles        = mount->maxCachedHandles;
+        outProfile->maxOpenFiles         = mount->maxOpenFiles;
+        return MOCHA_RESULT_SUCCESS;
+    });
+}
+
+static void fsaApplyIOProfile(FSADeviceData *mount, const MochaFSIOProfile *profile) {
+    if (profile->readChunkSize >= 0x40) {
+        mount->readChunkSize = profile->readChunkSize & ~0x3F;
+    }
+    if (profile->writeChunkSize >= 0x40) {
+        mount->writeChunkSize = profile->writeChunkSize & ~0x3F;
+    }
+    if (profile->inFlightDepth > 0) {
+        mount->pipelineDepth = profile->inFlightDepth;
+    }
+    mount->bounceBufferSize = profile->bounceBufferSize & ~0x3F;
+    mount->readAheadSize    = profile->readAheadSize & ~0x3F;
+    mount->writeBufferSize  = profile->writeBufferSize & ~0x3F;
+    if (profile->maxClients > 0) {
+        mount->maxClients = MIN(profile->maxClients, FSA_MAX_CLIENTS_PER_MOUNT);
+    }
+    mount->cacheFileStat = !profile->uncachedFileStat;
+    if (!__fsa_metadata_cache_configure(mount, profile->metadataCacheEntries, profile->metadataCacheTTL)) {
+        DEBUG_FUNCTION_LINE_WARN("Failed to allocate the metadata cache for %s", mount->name);
+    }
+    if (!__fsa_handle_cache_configure(mount, MIN(profile->cachedHandles, FSA_MAX_CACHED_HANDLES))) {
+        DEBUG_FUNCTION_LINE_WARN("Failed to allocate the handle cache for %s", mount->name);
+    }
+    mount->maxOpenFiles = profile->maxOpenFiles;
+}
+
+// Transfers FSA_CALIBRATION_SIZE bytes from the start of the file in requests of chunkSize bytes.
+// Returns the throughput in bytes per millisecond, 0 on error.
+static uint64_t fsaMeasureChunkSize(FSADeviceData *mount, FSAFileHandle fd, uint8_t *buffer, uint32_t chunkSize, bool write) {
+    FSError res;
+    if ((res = FSASetPosFile(mount->clientHandle, fd, 0)) < 0) {
+        DEBUG_FUNCTION_LINE_WARN("FSASetPosFile(0x%08X, 0x%08X, 0) failed: %s", mount->clientHandle, fd, FSAGetStatusStr(res));
+        return 0;
+    }
+
+    const OSTime start = OSGetTime();
+    for (uint32_t offset = 0; offset < FSA_CALIBRATION_SIZE; offset += chunkSize) {
+        if (write) {
+            res = FSAWriteFile(mount->clientHandle, buffer + offset, 1, chunkSize, fd, 0);
+        } else {
+            res = FSAReadFile(mount->clientHandle, buffer + offset, 1, chunkSize, fd, 0);
+        }
+        if (res != (FSError) chunkSize) {
+            DEBUG_FUNCTION_LINE_WARN("Calibration %s of 0x%08X bytes on %s failed: %s", write ? "write" : "read", chunkSize, mount->name, FSAGetStatusStr(res));
+            return 0;
+        }
+    }
+    if (write && (res = FSAFlushFile(mount->clientHandle, fd)) < 0) {
+        DEBUG_FUNCTION_LINE_WARN("FSAFlushFile(0x%08X, 0x%08X) failed: %s", mount->clientHandle, fd, FSAGetStatusStr(res));
+        return 0;
+    }
+    const uint64_t us = OSTicksToMicroseconds(OSGetTime() - start);
+    return (uint64_t) FSA_CALIBRATION_SIZE * 1000 / (us > 0 ? us : 1);
+}
+
+// Picks the read and write chunk sizes with the highest throughput using a temporary file in the root of the mount.
+// The chunk sizes of the mount are kept if anything fails, e.g. because the mount is read-only.
+static void fsaCalibrate(FSADeviceData *mount) {
+    static constexpr uint32_t chunkSizes[] = {0x10000, 0x20000, 0x40000, 0x80000, 0x100000, 0x200000};
+
+    auto *buffer = (uint8_t *) memalign(0x40, FSA_CALIBRATION_SIZE);
+    if (!buffer) {
+        DEBUG_FUNCTION_LINE_WARN("Failed to allocate calibration buffer for %s", mount->name);
+        return;
+    }
+    memset(buffer, 0xA5, FSA_CALIBRATION_SIZE);
+
+    const std::string path = std::string(mount->mountPath).append("/.mocha_calibration");
+    FSAFileHandle fd;
+    FSError res = FSAOpenFileEx(mount->clientHandle, path.c_str(), "w+", (FSMode) 0x660, FS_OPEN_FLAG_NONE, 0, &fd);
+    if (res < 0) {
+        DEBUG_FUNCTION_LINE_WARN("Skipping calibration of %s, FSAOpenFileEx(0x%08X, %s) failed: %s", mount->name, mount->clientHandle, path.c_str(), FSAGetStatusStr(res));
+        free(buffer);
+        return;
+    }
+
+    // The first write allocates the file, don't let it count for the smallest chunk size.
+    uint64_t bestWrite = fsaMeasureChunkSize(mount, fd, buffer, FSA_CALIBRATION_SIZE, true);
+    if (bestWrite > 0) {
+        uint32_t bestWriteChunk = 0;
+        uint32_t bestReadChunk  = 0;
+        uint64_t bestRead       = 0;
+        bestWrite               = 0;
+        for (const uint32_t chunkSize : chunkSizes) {
+            const uint64_t writeSpeed = fsaMeasureChunkSize(mount, fd, buffer, chunkSize, true);
+            const uint64_t readSpeed  = fsaMeasureChunkSize(mount, fd, buffer, chunkSize, false);
+            if (writeSpeed == 0 || readSpeed == 0) {
+                bestWriteChunk = 0;
+                bestReadChunk  = 0;
+                break;
+            }
+            if (writeSpeed > bestWrite) {
+                bestWrite      = writeSpeed;
+                bestWriteChunk = chunkSize;
+            }
+            if (readSpeed > bestRead) {
+                bestRead      = readSpeed;
+                bestReadChunk = chunkSize;
+            }
+        }
+        if (bestWriteChunk > 0 && bestReadChunk > 0) {
+            mount->readChunkSize  = bestReadChunk;
+            mount->writeChunkSize = bestWriteChunk;
+            DEBUG_FUNCTION_LINE_INFO("Calibrated %s: read chunk 0x%08X (%llu KiB/s), write chunk 0x%08X (%llu KiB/s)",
+                                     mount->name, bestReadChunk, bestRead * 1000 / 1024, bestWriteChunk, bestWrite * 1000 / 1024);
+        }
+    }
+
+    FSACloseFile(mount->clientHandle, fd);
+    if ((res = FSARemove(mount->clientHandle, path.c_str())) < 0) {
+        DEBUG_FUNCTION_LINE_WARN("FSARemove(0x%08X, %s) failed: %s", mount->clientHandle, path.c_str(), FSAGetStatusStr(res));
+    }
+    free(buffer);
+}
+
+MochaUtilsStatus Mocha_MountFSSetMetadataCache(const char *virt_name, uint32_t maxEntries, uint32_t ttlMs) {
+    if (!virt_name) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    return fsaWithMount(virt_name, [&](FSADeviceData *mount) {
+        if (!__fsa_metadata_cache_configure(mount, maxEntries, ttlMs)) {
+            return MOCHA_RESULT_OUT_OF_MEMORY;
+        }
+        return MOCHA_RESULT_SUCCESS;
+    });
+}
+
+MochaUtilsStatus Mocha_MountFSSetHandleCache(const char *virt_name, uint32_t maxHandles) {
+    if (!virt_name || maxHandles > FSA_MAX_CACHED_HANDLES) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    return fsaWithMount(virt_name, [&](FSADeviceData *mount) {
+        if (!__fsa_handle_cache_configure(mount, maxHandles)) {
+            return MOCHA_RESULT_OUT_OF_MEMORY;
+        }
+        return MOCHA_RESULT_SUCCESS;
+    });
+}
+
+MochaUtilsStatus Mocha_MountFSSetMaxOpenFiles(const char *virt_name, uint32_t maxOpenFiles) {
+    if (!virt_name) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    return fsaWithMount(virt_name, [&](FSADeviceData *mount) {
+        mount->maxOpenFiles = maxOpenFiles;
+        return MOCHA_RESULT_SUCCESS;
+    });
+}
+
+MochaUtilsStatus Mocha_MountFSSetMaxClients(const char *virt_name, uint32_t maxClients) {
+    if (!virt_name || maxClients < 1 || maxClients > FSA_MAX_CLIENTS_PER_MOUNT) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    return fsaWithMount(virt_name, [&](FSADeviceData *mount) {
+        mount->maxClients = maxClients;
+        return MOCHA_RESULT_SUCCESS;
+    });
+}
+
+MochaUtilsStatus Mocha_MountFSSetPreallocationHint(const char *virt_name, uint32_t size) {
+    if (!virt_name) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    return fsaWithMount(virt_name, [&](FSADeviceData *mount) {
+        mount->preallocSize = size;
+        return MOCHA_RESULT_SUCCESS;
+    });
+}
+
 extern int mochaInitDone;
 
 MochaUtilsStatus Mocha_MountFS(const char *virt_name, const char *dev_path, const char *mount_path) {
@@ -129,6 +384,11 @@ MochaUtilsStatus Mocha_MountFS(const char *virt_name, const char *dev_path, cons
 }
 
 MochaUtilsStatus Mocha_MountFSEx(const char *virt_name, const char *dev_path, const char *mount_path, FSAMountFlags mountFlags, void *mountArgBuf, int mountArgBufLen) {
+    return Mocha_MountFSWithProfile(virt_name, dev_path, mount_path, mountFlags, mountArgBuf, mountArgBufLen, nullptr);
+}
+
+MochaUtilsStatus Mocha_MountFSWithProfile(const char *virt_name, const char *dev_path, const char *mount_path, FSAMountFlags mountFlags, void *mountArgBuf, int mountArgBufLen,
+                                          const MochaFSIOProfile *profile) {
     if (virt_name == nullptr || mount_path == nullptr) {
         return MOCHA_RESULT_INVALID_ARGUMENT;
     }
@@ -178,6 +438,9 @@ MochaUtilsStatus Mocha_MountFSEx(const char *virt_name, const char *dev_path, co
         DEBUG_FUNCTION_LINE_ERR("Mocha_UnlockFSClientEx failed: %s", Mocha_GetStatusStr(status));
         return MOCHA_RESULT_UNSUPPORTED_COMMAND;
     }
+    mount->clients[0]     = mount->clientHandle;
+    mount->clientUsers[0] = 0;
+    mount->numClients     = 1;
 
     mount->mounted = false;
 
@@ -215,6 +478,13 @@ MochaUtilsStatus Mocha_MountFSEx(const char *virt_name, const char *dev_path, co
         DEBUG_FUNCTION_LINE_WARN("Failed to get DeviceInfo for %s: %s", normalizedMountPath.c_str(), FSAGetStatusStr(res));
     }
 
+    if (profile) {
+        fsaApplyIOProfile(mount, profile);
+        if (profile->calibrate) {
+            fsaCalibrate(mount);
+        }
+    }
+
     if (AddDevice(&mount->device) < 0) {
         DEBUG_FUNCTION_LINE_ERR("AddDevice failed for %s.", virt_name);
         fsa_free(mount);
@@ -12,6 +12,16 @@
 #include <sys/param.h>
 #include <unistd.h>
 
+class FSAMetadataCache;
+class FSAHandleCache;
+struct __fsa_file_t;
+
+// Maximum number of FSA clients per mount
+#define FSA_MAX_CLIENTS_PER_MOUNT 8
+
+// Maximum number of read-only handles a mount keeps open after they have been closed, well below the open file limit of IOSU
+#define FSA_MAX_CACHED_HANDLES 32
+
 typedef struct FSADeviceData {
     devoptab_t device;
     bool setup;
@@ -24,19 +34,66 @@ typedef struct FSADeviceData {
     FSAClientHandle clientHandle;
     uint64_t deviceSizeInSectors;
     uint32_t deviceSectorSize;
+    //! Size of the readahead buffer of files opened on this mount, 0 if disabled
+    uint32_t readAheadSize;
+    //! Size of the write-behind buffer of files opened on this mount, 0 if disabled
+    uint32_t writeBufferSize;
+    //! Maximum size of a single read request, multiple of 0x40
+    uint32_t readChunkSize;
+    //! Maximum size of a single write request, multiple of 0x40
+    uint32_t writeChunkSize;
+    //! Number of requests that are kept in flight for transfers larger than a chunk
+    uint32_t pipelineDepth;
+    //! Misaligned transfers up to this size go through a single temporary buffer, 0 if disabled
+    uint32_t bounceBufferSize;
+    //! Upper bound for the number of clients that are created for this mount
+    uint32_t maxClients;
+    //! Number of valid entries in clients
+    uint32_t numClients;
+    //! Unlocked FSA clients, clients[0] is clientHandle. Files and directories stay on the client they have been opened with.
+    FSAClientHandle clients[FSA_MAX_CLIENTS_PER_MOUNT];
+    //! Number of open files, directories and running operations per client
+    uint32_t clientUsers[FSA_MAX_CLIENTS_PER_MOUNT];
+    //! Guards the client pool
+    MutexWrapper clientMutex;
+    //! Answer fstat and SEEK_END of open files from the stat that has been cached in the file
+    bool cacheFileStat;
+    //! Results of FSAGetStat by path, nullptr if it has never been enabled
+    FSAMetadataCache *metadataCache;
+    //! Configuration of metadataCache, 0 entries if disabled
+    uint32_t metadataCacheEntries;
+    uint32_t metadataCacheTTL;
+    //! Size that is preallocated for files opened with O_PREALLOCATE, 0 if disabled
+    uint32_t preallocSize;
+    //! Closed read-only files that are kept open for the next open of the same path, nullptr if it has never been enabled
+    FSAHandleCache *handleCache;
+    //! Configuration of handleCache, 0 if disabled
+    uint32_t maxCachedHandles;
+    //! Number of FSA handles the virtualized files of this mount may keep open, 0 if files opened on this mount are not virtualized
+    uint32_t maxOpenFiles;
+    //! Number of files in the open files list
+    uint32_t numOpenFiles;
+    //! Virtualized files with an open FSA handle, most recently used first
+    struct __fsa_file_t *openFilesHead;
+    struct __fsa_file_t *openFilesTail;
+    //! Guards the open files list and the pins of all files of the mount
+    MutexWrapper openFilesMutex;
 } __fsa_device_t;
 
 /**
  * Open file struct
  */
-typedef struct {
+typedef struct __fsa_file_t {
+    //! FSA client the file has been opened with
+    FSAClientHandle clientHandle;
+
     //! FSA file handle
     FSAFileHandle fd;
 
     //! Flags used in open(2)
     int flags;
 
-    //! Current file offset
+    //! Current file offset. Reads and writes pass it to FSA explicitly, the position of the FSA handle is only used by ftruncate and O_APPEND writes.
     uint32_t offset;
 
     //! Current file path
@@ -47,6 +104,63 @@ typedef struct {
 
     //! Current file size (only valid if O_APPEND is set)
     uint32_t appendOffset;
+
+    //! 0x40 aligned readahead buffer, allocated on the first small read
+    uint8_t *readBuffer;
+
+    //! Size of readBuffer, 0 if the readahead is disabled
+    uint32_t readBufferSize;
+
+    //! File offset of the first byte in readBuffer
+    uint32_t readBufferOffset;
+
+    //! Number of valid bytes in readBuffer
+    uint32_t readBufferLength;
+
+    //! 0x40 aligned write-behind buffer, allocated on the first small write
+    uint8_t *writeBuffer;
+
+    //! Size of writeBuffer, 0 if the write-behind is disabled
+    uint32_t writeBufferSize;
+
+    //! Number of bytes in writeBuffer that still have to be written at (offset - writeBufferLength)
+    uint32_t writeBufferLength;
+
+    //! Cached result of FSAGetStatFile, see statValid and sizeValid
+    FSAStat stat;
+
+    //! stat can be used for fstat, cleared by writes
+    bool statValid;
+
+    //! stat.size is the current size of the file including pending writes, kept up to date by writes and ftruncate
+    bool sizeValid;
+
+    //! Whether stat may be cached at all (not for O_SYNC files or if the mount disabled it)
+    bool cacheStat;
+
+    //! Keep the FSA handle open in the handle cache of the mount on close, only for plain read-only files
+    bool cacheHandle;
+
+    //! fd may be closed while the file is idle and is reopened on demand, see maxOpenFiles of the mount
+    bool virtualized;
+
+    //! fd is an open FSA handle
+    bool handleOpen;
+
+    //! The file is in the open files list of the mount
+    bool listed;
+
+    //! Number of positional transfers that use fd without holding the mutex, the handle can't be closed while > 0
+    uint32_t pins;
+
+    //! Neighbours in the open files list of the mount
+    struct __fsa_file_t *prevOpen;
+    struct __fsa_file_t *nextOpen;
+
+    //! Arguments for FSAOpenFileEx when the handle has to be reopened
+    const char *reopenMode;
+    FSMode permissions;
+    FSOpenFileFlags openFlags;
 } __fsa_file_t;
 
 /**
@@ -56,6 +170,9 @@ typedef struct {
     //! Should be set to FSA_DIRITER_MAGIC
     uint32_t magic;
 
+    //! FSA client the directory has been opened with
+    FSAClientHandle clientHandle;
+
     //! FS directory handle
     FSADirectoryHandle fd;
 
@@ -65,12 +182,20 @@ typedef struct {
     //! Current directory path
     char fullPath[FS_MAX_PATH + 1];
 
+    //! __fsa_hashstring of fullPath followed by a '/', continued for the inode of every entry
+    uint32_t pathHash;
+
     //! Guard dir access
     MutexWrapper mutex;
 } __fsa_dir_t;
 
 #define FSA_DIRITER_MAGIC 0x77696975
 
+// Default I/O profile of a mount
+#define FSA_DEFAULT_READ_CHUNK_SIZE  0x100000
+#define FSA_DEFAULT_WRITE_CHUNK_SIZE 0x40000
+#define FSA_DEFAULT_PIPELINE_DEPTH   3
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -107,11 +232,53 @@ int __fsa_rmdir(struct _reent *r, const char *name);
 int __fsa_utimes(struct _reent *r, const char *filename, const struct timeval times[2]);
 
 // devoptab_fsa_utils.c
-char *__fsa_fixpath(struct _reent *r, const char *path);
+// Resolves path into fixedPath, which must have room for FS_MAX_PATH + 1 chars. Returns fixedPath, or NULL and sets errno on error.
+char *__fsa_fixpath(struct _reent *r, const char *path, char *fixedPath);
 int __fsa_translate_error(FSError error);
 mode_t __fsa_translate_stat_mode(FSStat *fsStat);
 void __fsa_translate_stat(FSAClientHandle handle, FSStat *fsStat, ino_t ino, struct stat *posStat);
 uint32_t __fsa_hashstring(const char *str);
+uint32_t __fsa_hashstring_append(uint32_t h, const char *str);
+void __fsa_drop_readahead(__fsa_file_t *file);
+FSError __fsa_flush_write_buffer(__fsa_device_t *deviceData, __fsa_file_t *file);
+FSError __fsa_update_file_stat(__fsa_device_t *deviceData, __fsa_file_t *file, bool sizeOnly);
+void __fsa_invalidate_path(__fsa_device_t *deviceData, const char *path, bool withChildren);
+
+// devoptab_fsa_clients.cpp
+FSAClientHandle __fsa_acquire_client(__fsa_device_t *deviceData);
+void __fsa_release_client(__fsa_device_t *deviceData, FSAClientHandle clientHandle);
+void __fsa_free_clients(__fsa_device_t *deviceData);
+
+// devoptab_fsa_metadata_cache.cpp
+bool __fsa_metadata_cache_configure(__fsa_device_t *deviceData, uint32_t maxEntries, uint32_t ttlMs);
+void __fsa_metadata_cache_free(__fsa_device_t *deviceData);
+FSError __fsa_get_stat_cached(const __fsa_device_t *deviceData, FSAClientHandle clientHandle, const char *path, FSAStat *outStat);
+uint32_t __fsa_metadata_cache_generation(const __fsa_device_t *deviceData);
+void __fsa_metadata_cache_prime(const __fsa_device_t *deviceData, const char *dirPath, const char *name, const FSAStat *stat, uint32_t generation);
+bool __fsa_metadata_cache_known_missing(const __fsa_device_t *deviceData, const char *path);
+void __fsa_metadata_cache_invalidate(const __fsa_device_t *deviceData, const char *path, bool withChildren);
+
+// devoptab_fsa_handle_cache.cpp
+bool __fsa_handle_cache_configure(__fsa_device_t *deviceData, uint32_t maxHandles);
+void __fsa_handle_cache_free(__fsa_device_t *deviceData);
+bool __fsa_handle_cache_take(__fsa_device_t *deviceData, const char *path, FSAClientHandle *outClientHandle, FSAFileHandle *outFd);
+bool __fsa_handle_cache_put(__fsa_device_t *deviceData, const char *path, FSAClientHandle clientHandle, FSAFileHandle fd);
+void __fsa_handle_cache_evict(__fsa_device_t *deviceData, const char *path, bool withChildren);
+bool __fsa_handle_cache_clear(__fsa_device_t *deviceData);
+
+// devoptab_fsa_file_handles.cpp
+FSError __fsa_open_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file, FSAClientHandle clientHandle, const char *mode,
+                               FSMode permissions, FSOpenFileFlags openFlags, uint32_t preAllocSize, FSAFileHandle *outFd);
+void __fsa_register_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file);
+void __fsa_unregister_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file);
+FSError __fsa_acquire_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file);
+FSError __fsa_pin_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file);
+void __fsa_unpin_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file);
+bool __fsa_file_handle_pinned(__fsa_device_t *deviceData, const __fsa_file_t *file);
+void __fsa_lock_unpinned_file(__fsa_device_t *deviceData, __fsa_file_t *file);
+
+// devoptab_fsa_pipeline.cpp
+FSError __fsa_transfer_pipelined(FSAClientHandle clientHandle, __fsa_file_t *file, FSACommandEnum command, uint8_t *buffer, uint32_t size, uint32_t pos, uint32_t chunkSize, uint32_t depth);
 
 static inline FSMode
 __fsa_translate_permission_mode(mode_t mode) {
@@ -121,6 +288,48 @@ __fsa_translate_permission_mode(mode_t mode) {
 
 time_t __fsa_translate_time(FSTime timeValue);
 
+// Keeps the cached stat of a file consistent after data has been written up to end
+static inline void
+__fsa_update_cached_size(__fsa_file_t *file, uint32_t end) {
+    file->statValid = false;
+    if (file->sizeValid && end > file->stat.size) {
+        file->stat.size = end;
+    }
+}
+
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
+
+/**
+ * Borrows the least used client of a mount until it goes out of scope, or until detach() hands it over
+ * to an open file or directory.
+ */
+class FSAClientLease {
+public:
+    explicit FSAClientLease(__fsa_device_t *deviceData) : mDeviceData(deviceData), mHandle(__fsa_acquire_client(deviceData)) {}
+
+    // Takes over a client that is already in use, e.g. by a handle from the handle cache.
+    FSAClientLease(__fsa_device_t *deviceData, FSAClientHandle acquired) : mDeviceData(deviceData), mHandle(acquired) {}
+
+    ~FSAClientLease() {
+        if (mDeviceData) {
+            __fsa_release_client(mDeviceData, mHandle);
+        }
+    }
+
+    FSAClientLease(const FSAClientLease &)            = delete;
+    FSAClientLease &operator=(const FSAClientLease &) = delete;
+
+    [[nodiscard]] FSAClientHandle handle() const { return mHandle; }
+
+    // Keeps the client in use, it has to be released with __fsa_release_client.
+    FSAClientHandle detach() {
+        mDeviceData = nullptr;
+        return mHandle;
+    }
+
+private:
+    __fsa_device_t *mDeviceData;
+    FSAClientHandle mHandle;
+};
@@ -9,9 +9,8 @@ int __fsa_chdir(struct _reent *r,
         return -1;
     }
 
-    char *fixedPath = __fsa_fixpath(r, path);
-    if (!fixedPath) {
-        r->_errno = ENOMEM;
+    char fixedPath[FS_MAX_PATH + 1];
+    if (!__fsa_fixpath(r, path, fixedPath)) {
         return -1;
     }
     const auto deviceData = static_cast<__fsa_device_t *>(r->deviceData);
@@ -19,7 +18,6 @@ int __fsa_chdir(struct _reent *r,
     const FSError status = FSAChangeDir(deviceData->clientHandle, fixedPath);
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSAChangeDir(0x%08X, %s) failed: %s", deviceData->clientHandle, fixedPath, FSAGetStatusStr(status));
-        free(fixedPath);
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
@@ -35,7 +33,5 @@ int __fsa_chdir(struct _reent *r,
         DEBUG_FUNCTION_LINE_WARN("__wut_fsa_chdir: snprintf result was truncated");
     }
 
-    free(fixedPath);
-
     return 0;
 }
@@ -11,25 +11,24 @@ int __fsa_chmod(struct _reent *r,
         return -1;
     }
 
-    char *fixedPath = __fsa_fixpath(r, path);
-    if (!fixedPath) {
-        r->_errno = ENOMEM;
+    char fixedPath[FS_MAX_PATH + 1];
+    if (!__fsa_fixpath(r, path, fixedPath)) {
         return -1;
     }
 
     const FSMode translatedMode = __fsa_translate_permission_mode(mode);
 
-    const __fsa_device_t *deviceData = static_cast<__fsa_device_t *>(r->deviceData);
+    auto *deviceData = static_cast<__fsa_device_t *>(r->deviceData);
 
-    const FSError status = FSAChangeMode(deviceData->clientHandle, fixedPath, translatedMode);
+    FSAClientLease client(deviceData);
+    const FSError status = FSAChangeMode(client.handle(), fixedPath, translatedMode);
+    __fsa_invalidate_path(deviceData, fixedPath, false);
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSAChangeMode(0x%08X, %s, 0x%X) failed: %s",
-                                deviceData->clientHandle, fixedPath, translatedMode, FSAGetStatusStr(status));
-        free(fixedPath);
+                                client.handle(), fixedPath, translatedMode, FSAGetStatusStr(status));
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
-    free(fixedPath);
 
     return 0;
 }
@@ -0,0 +1,62 @@
+#include "../logger.h"
+#include "devoptab_fsa.h"
+#include "mocha/mocha.h"
+#include <mutex>
+
+FSAClientHandle
+__fsa_acquire_client(__fsa_device_t *deviceData) {
+    std::scoped_lock lock(deviceData->clientMutex);
+
+    uint32_t best = 0;
+    for (uint32_t i = 1; i < deviceData->numClients; i++) {
+        if (deviceData->clientUsers[i] < deviceData->clientUsers[best]) {
+            best = i;
+        }
+    }
+
+    // Only add a client if all existing ones are busy
+    if (deviceData->clientUsers[best] > 0 && deviceData->numClients < MIN(deviceData->maxClients, FSA_MAX_CLIENTS_PER_MOUNT)) {
+        const FSAClientHandle client = FSAAddClient(nullptr);
+        if (client < 0) {
+            DEBUG_FUNCTION_LINE_WARN("FSAAddClient() for %s failed: %s", deviceData->name, FSAGetStatusStr(static_cast<FSError>(client)));
+        } else if (const MochaUtilsStatus status = Mocha_UnlockFSClientEx(client); status != MOCHA_RESULT_SUCCESS) {
+            DEBUG_FUNCTION_LINE_WARN("Mocha_UnlockFSClientEx for %s failed: %s", deviceData->name, Mocha_GetStatusStr(status));
+            FSADelClient(client);
+        } else {
+            best                          = deviceData->numClients++;
+            deviceData->clients[best]     = client;
+            deviceData->clientUsers[best] = 0;
+        }
+    }
+
+    deviceData->clientUsers[best]++;
+    return deviceData->clients[best];
+}
+
+void
+__fsa_release_client(__fsa_device_t *deviceData, FSAClientHandle clientHandle) {
+    std::scoped_lock lock(deviceData->clientMutex);
+
+    for (uint32_t i = 0; i < deviceData->numClients; i++) {
+        if (deviceData->clients[i] == clientHandle) {
+            if (deviceData->clientUsers[i] > 0) {
+                deviceData->clientUsers[i]--;
+            }
+            return;
+        }
+    }
+}
+
+void
+__fsa_free_clients(__fsa_device_t *deviceData) {
+    std::scoped_lock lock(deviceData->clientMutex);
+
+    // clients[0] is the main client of the mount, it's deleted with the mount.
+    for (uint32_t i = 1; i < deviceData->numClients; i++) {
+        const FSError res = FSADelClient(deviceData->clients[i]);
+        if (res < 0) {
+            DEBUG_FUNCTION_LINE_WARN("FSADelClient for %s failed: %s", deviceData->name, FSAGetStatusStr(res));
+        }
+    }
+    deviceData->numClients = MIN(deviceData->numClients, 1);
+}
@@ -15,10 +15,34 @@ int __fsa_close(struct _reent *r,
 
     std::scoped_lock lock(file->mutex);
 
-    const FSError status = FSACloseFile(deviceData->clientHandle, file->fd);
+    free(file->readBuffer);
+    file->readBuffer       = nullptr;
+    file->readBufferLength = 0;
+
+    const FSError flushStatus = __fsa_flush_write_buffer(deviceData, file);
+    free(file->writeBuffer);
+    file->writeBuffer       = nullptr;
+    file->writeBufferLength = 0;
+
+    // No other file may close the handle from now on
+    __fsa_unregister_file_handle(deviceData, file);
+
+    // The handle cache keeps plain read-only files open, together with their client
+    FSError status = FS_ERROR_OK;
+    if (!file->handleOpen) {
+        // The handle has been closed already to make room for other files
+        __fsa_release_client(deviceData, file->clientHandle);
+    } else if (!file->cacheHandle || !__fsa_handle_cache_put(deviceData, file->fullPath, file->clientHandle, file->fd)) {
+        status = FSACloseFile(file->clientHandle, file->fd);
+        __fsa_release_client(deviceData, file->clientHandle);
+    }
+    if (flushStatus < 0) {
+        r->_errno = __fsa_translate_error(flushStatus);
+        return -1;
+    }
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSACloseFile(0x%08X, 0x%08X) (%s) failed: %s",
-                                deviceData->clientHandle, file->fd, file->fullPath, FSAGetStatusStr(status));
+                                file->clientHandle, file->fd, file->fullPath, FSAGetStatusStr(status));
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
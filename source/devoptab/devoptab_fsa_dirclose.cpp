@@ -16,10 +16,11 @@ int __fsa_dirclose(struct _reent *r,
 
     std::scoped_lock lock(dir->mutex);
 
-    const FSError status = FSACloseDir(deviceData->clientHandle, dir->fd);
+    const FSError status = FSACloseDir(dir->clientHandle, dir->fd);
+    __fsa_release_client(deviceData, dir->clientHandle);
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSACloseDir(0x%08X, 0x%08X) (%s) failed: %s",
-                                deviceData->clientHandle, dir->fd, dir->fullPath, FSAGetStatusStr(status));
+                                dir->clientHandle, dir->fd, dir->fullPath, FSAGetStatusStr(status));
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
@@ -1,6 +1,5 @@
 #include "../logger.h"
 #include "devoptab_fsa.h"
-#include <cstdio>
 #include <mutex>
 
 int __fsa_dirnext(struct _reent *r,
@@ -17,36 +16,33 @@ int __fsa_dirnext(struct _reent *r,
     const auto dir        = static_cast<__fsa_dir_t *>(dirState->dirStruct);
 
     std::scoped_lock lock(dir->mutex);
-    memset(&dir->entry_data, 0, sizeof(dir->entry_data));
 
-    const auto status = FSAReadDir(deviceData->clientHandle, dir->fd, &dir->entry_data);
+    const uint32_t cacheGeneration = __fsa_metadata_cache_generation(deviceData);
+
+    const auto status = FSAReadDir(dir->clientHandle, dir->fd, &dir->entry_data);
     if (status < 0) {
         if (status != FS_ERROR_END_OF_DIR) {
             DEBUG_FUNCTION_LINE_ERR("FSAReadDir(0x%08X, 0x%08X, %p) (%s) failed: %s",
-                                    deviceData->clientHandle, dir->fd, &dir->entry_data, dir->fullPath, FSAGetStatusStr(status));
+                                    dir->clientHandle, dir->fd, &dir->entry_data, dir->fullPath, FSAGetStatusStr(status));
         }
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
 
-    ino_t ino;
-    size_t fullLen = strlen(dir->fullPath) + 1 + strlen(dir->entry_data.name) + 1;
-    char *fullStr  = (char *) memalign(0x40, fullLen);
-    if (fullStr) {
-        if (snprintf(fullStr, fullLen, "%s/%s", dir->fullPath, dir->entry_data.name) >= (int) fullLen) {
-            DEBUG_FUNCTION_LINE_ERR("__fsa_dirnext: snprintf fullStr result was truncated");
-        }
-        ino = __fsa_hashstring(fullStr);
-        free(fullStr);
-    } else {
-        ino = 0;
-        DEBUG_FUNCTION_LINE_ERR("__fsa_dirnext: Failed to allocate memory for fullStr. st_ino will be set to 0");
-    }
+    // Same as hashing "<fullPath>/<name>", without building the full path for every entry
+    const ino_t ino = __fsa_hashstring_append(dir->pathHash, dir->entry_data.name);
     __fsa_translate_stat(deviceData->clientHandle, &dir->entry_data.info, ino, filestat);
 
-    if (snprintf(filename, NAME_MAX, "%s", dir->entry_data.name) >= NAME_MAX) {
-        DEBUG_FUNCTION_LINE_ERR("__fsa_dirnext: snprintf filename result was truncated");
+    // The entry already has the full stat, so a stat() of the entry right after listing it doesn't need another request
+    __fsa_metadata_cache_prime(deviceData, dir->fullPath, dir->entry_data.name, &dir->entry_data.info, cacheGeneration);
+
+    const size_t nameLen = strnlen(dir->entry_data.name, sizeof(dir->entry_data.name));
+    if (nameLen >= NAME_MAX) {
+        DEBUG_FUNCTION_LINE_ERR("__fsa_dirnext: filename was truncated");
     }
+    const size_t copyLen = MIN(nameLen, NAME_MAX - 1);
+    memcpy(filename, dir->entry_data.name, copyLen);
+    filename[copyLen] = '\0';
 
     return 0;
 }
@@ -10,15 +10,14 @@ int __fsa_dirreset(struct _reent *r,
         return -1;
     }
 
-    const auto dir         = static_cast<__fsa_dir_t *>(dirState->dirStruct);
-    const auto *deviceData = static_cast<__fsa_device_t *>(r->deviceData);
+    const auto dir = static_cast<__fsa_dir_t *>(dirState->dirStruct);
 
     std::scoped_lock lock(dir->mutex);
 
-    const FSError status = FSARewindDir(deviceData->clientHandle, dir->fd);
+    const FSError status = FSARewindDir(dir->clientHandle, dir->fd);
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSARewindDir(0x%08X, 0x%08X) (%s) failed: %s",
-                                deviceData->clientHandle, dir->fd, dir->fullPath, FSAGetStatusStr(status));
+                                dir->clientHandle, dir->fd, dir->fullPath, FSAGetStatusStr(status));
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
@@ -0,0 +1,180 @@
+#include "../logger.h"
+#include "devoptab_fsa.h"
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <mutex>
+
+// The open files list of a mount has to be locked for these
+
+static void __fsa_unlist_file(__fsa_device_t *deviceData, __fsa_file_t *file) {
+    if (file->prevOpen) {
+        file->prevOpen->nextOpen = file->nextOpen;
+    } else {
+        deviceData->openFilesHead = file->nextOpen;
+    }
+    if (file->nextOpen) {
+        file->nextOpen->prevOpen = file->prevOpen;
+    } else {
+        deviceData->openFilesTail = file->prevOpen;
+    }
+    file->prevOpen = nullptr;
+    file->nextOpen = nullptr;
+    file->listed   = false;
+    deviceData->numOpenFiles--;
+}
+
+static void __fsa_list_file(__fsa_device_t *deviceData, __fsa_file_t *file) {
+    file->prevOpen = nullptr;
+    file->nextOpen = deviceData->openFilesHead;
+    if (deviceData->openFilesHead) {
+        deviceData->openFilesHead->prevOpen = file;
+    } else {
+        deviceData->openFilesTail = file;
+    }
+    deviceData->openFilesHead = file;
+    file->listed              = true;
+    deviceData->numOpenFiles++;
+}
+
+// Closes the FSA handle of the least recently used virtualized file that is not in use right now.
+// Only closes a handle if the mount is at its limit, unless force is set. Returns true if a handle has been closed.
+static bool __fsa_close_lru_file(__fsa_device_t *deviceData, const __fsa_file_t *self, bool force) {
+    __fsa_file_t *victim = nullptr;
+    {
+        std::scoped_lock lock(deviceData->openFilesMutex);
+        if (!force && (deviceData->maxOpenFiles == 0 || deviceData->numOpenFiles < deviceData->maxOpenFiles)) {
+            return false;
+        }
+        // Never waits for the mutex of another file, that file might be waiting for this one.
+        for (auto *file = deviceData->openFilesTail; file; file = file->prevOpen) {
+            if (file != self && file->pins == 0 && file->mutex.try_lock()) {
+                victim = file;
+                break;
+            }
+        }
+        if (!victim) {
+            return false;
+        }
+        __fsa_unlist_file(deviceData, victim);
+    }
+
+    // Whatever can't be written stays buffered and is written after the file has been reopened
+    __fsa_flush_write_buffer(deviceData, victim);
+
+    const FSError status = FSACloseFile(victim->clientHandle, victim->fd);
+    if (status < 0) {
+        DEBUG_FUNCTION_LINE_WARN("FSACloseFile(0x%08X, 0x%08X) (%s) failed: %s",
+                                 victim->clientHandle, victim->fd, victim->fullPath, FSAGetStatusStr(status));
+    }
+    victim->handleOpen = false;
+    victim->mutex.unlock();
+    return true;
+}
+
+FSError
+__fsa_open_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file, FSAClientHandle clientHandle, const char *mode,
+                       FSMode permissions, FSOpenFileFlags openFlags, uint32_t preAllocSize, FSAFileHandle *outFd) {
+    if (file->virtualized) {
+        __fsa_close_lru_file(deviceData, file, false);
+    }
+
+    FSError status = FSAOpenFileEx(clientHandle, file->fullPath, mode, permissions, openFlags, preAllocSize, outFd);
+    if (status == FS_ERROR_MAX_FILES) {
+        // Give back the handles the mount keeps open on its own and try again
+        const bool freedCached = __fsa_handle_cache_clear(deviceData);
+        if (__fsa_close_lru_file(deviceData, file, true) || freedCached) {
+            status = FSAOpenFileEx(clientHandle, file->fullPath, mode, permissions, openFlags, preAllocSize, outFd);
+        }
+    }
+    return status;
+}
+
+void
+__fsa_register_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file) {
+    if (!file->virtualized || !file->handleOpen) {
+        return;
+    }
+    std::scoped_lock lock(deviceData->openFilesMutex);
+    if (!file->listed) {
+        __fsa_list_file(deviceData, file);
+    }
+}
+
+void
+__fsa_unregister_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file) {
+    if (!file->virtualized) {
+        return;
+    }
+    std::scoped_lock lock(deviceData->openFilesMutex);
+    if (file->listed) {
+        __fsa_unlist_file(deviceData, file);
+    }
+}
+
+FSError
+__fsa_acquire_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file) {
+    if (file->handleOpen) {
+        if (file->virtualized) {
+            std::scoped_lock lock(deviceData->openFilesMutex);
+            // Move to the front of the list, files that are being closed by __fsa_close_lru_file are not listed anymore.
+            if (file->listed && deviceData->openFilesHead != file) {
+                __fsa_unlist_file(deviceData, file);
+                __fsa_list_file(deviceData, file);
+            }
+        }
+        return FS_ERROR_OK;
+    }
+
+    // The handle has been closed to make room for other files. The file exists already, so the reopen mode never
+    // truncates it. Reads and writes pass their position explicitly, the position of the new handle doesn't matter.
+    FSAFileHandle fd;
+    const FSError status = __fsa_open_file_handle(deviceData, file, file->clientHandle, file->reopenMode,
+                                                  file->permissions, file->openFlags, 0, &fd);
+    if (status < 0) {
+        DEBUG_FUNCTION_LINE_ERR("FSAOpenFileEx(0x%08X, %s, %s, 0x%X, 0x%08X, 0, %p) failed while reopening: %s",
+                                file->clientHandle, file->fullPath, file->reopenMode, file->permissions, file->openFlags, &fd,
+                                FSAGetStatusStr(status));
+        return status;
+    }
+    file->fd         = fd;
+    file->handleOpen = true;
+    __fsa_register_file_handle(deviceData, file);
+    return FS_ERROR_OK;
+}
+
+// Pins are counted for all files, Mocha_FSPAllocate has to wait for running positional writes as well.
+FSError
+__fsa_pin_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file) {
+    const FSError status = __fsa_acquire_file_handle(deviceData, file);
+    if (status >= 0) {
+        std::scoped_lock lock(deviceData->openFilesMutex);
+        file->pins++;
+    }
+    return status;
+}
+
+void
+__fsa_unpin_file_handle(__fsa_device_t *deviceData, __fsa_file_t *file) {
+    std::scoped_lock lock(deviceData->openFilesMutex);
+    file->pins--;
+}
+
+bool
+__fsa_file_handle_pinned(__fsa_device_t *deviceData, const __fsa_file_t *file) {
+    std::scoped_lock lock(deviceData->openFilesMutex);
+    return file->pins > 0;
+}
+
+// Positional requests only hold the lock of the file while they start and end, so wait until none of them
+// is running anymore. New ones can't start while the lock is held.
+void
+__fsa_lock_unpinned_file(__fsa_device_t *deviceData, __fsa_file_t *file) {
+    while (true) {
+        file->mutex.lock();
+        if (!__fsa_file_handle_pinned(deviceData, file)) {
+            return;
+        }
+        file->mutex.unlock();
+        OSSleepTicks(OSMillisecondsToTicks(1));
+    }
+}
@@ -0,0 +1,226 @@
+#include "../logger.h"
+#include "devoptab_fsa.h"
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <string_view>
+
+/**
+ * Keeps the FSA handles of closed read-only files open, so the next open of the same path can reuse them.
+ * The least recently parked handle is closed when the cache is full.
+ * The entries are part of the cache, parking, taking and evicting a handle never allocates memory.
+ */
+class FSAHandleCache {
+public:
+    struct Handle {
+        FSAClientHandle clientHandle;
+        FSAFileHandle fd;
+    };
+
+    // Handles that have been removed from the cache, they have to be closed by the caller.
+    struct Evicted {
+        Handle handles[FSA_MAX_CACHED_HANDLES];
+        uint32_t count = 0;
+    };
+
+    FSAHandleCache() {
+        for (uint32_t i = 0; i < FSA_MAX_CACHED_HANDLES; i++) {
+            mEntries[i].lruNext = (i + 1 < FSA_MAX_CACHED_HANDLES) ? (int32_t) i + 1 : -1;
+        }
+        mFreeHead = 0;
+    }
+
+    void configure(uint32_t maxHandles, Evicted &out) {
+        std::lock_guard lock(mMutex);
+        mMaxHandles = MIN(maxHandles, FSA_MAX_CACHED_HANDLES);
+        while (mCount > mMaxHandles) {
+            evictEntry(mLruTail, out);
+        }
+    }
+
+    bool take(const char *path, FSAClientHandle *outClientHandle, FSAFileHandle *outFd) {
+        std::lock_guard lock(mMutex);
+        for (int32_t idx = mLruHead; idx >= 0; idx = mEntries[idx].lruNext) {
+            auto &entry = mEntries[idx];
+            if (strcmp(entry.path, path) == 0) {
+                *outClientHandle = entry.clientHandle;
+                *outFd           = entry.fd;
+                release(idx);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Returns false if the cache is disabled. Moves the least recently parked handle to out if the cache is full.
+    bool put(const char *path, FSAClientHandle clientHandle, FSAFileHandle fd, Evicted &out) {
+        std::lock_guard lock(mMutex);
+        const size_t len = strlen(path);
+        if (mMaxHandles == 0 || len > FS_MAX_PATH) {
+            return false;
+        }
+        if (mCount >= mMaxHandles) {
+            evictEntry(mLruTail, out);
+        }
+
+        const int32_t idx = mFreeHead;
+        auto &entry       = mEntries[idx];
+        mFreeHead         = entry.lruNext;
+        memcpy(entry.path, path, len + 1);
+        entry.clientHandle = clientHandle;
+        entry.fd           = fd;
+
+        entry.lruPrev = -1;
+        entry.lruNext = mLruHead;
+        if (mLruHead >= 0) {
+            mEntries[mLruHead].lruPrev = idx;
+        } else {
+            mLruTail = idx;
+        }
+        mLruHead = idx;
+        mCount++;
+        return true;
+    }
+
+    // Moves the handles of path (and everything below it if withChildren is set) to out.
+    void evict(std::string_view path, bool withChildren, Evicted &out) {
+        std::lock_guard lock(mMutex);
+        for (int32_t idx = mLruHead; idx >= 0;) {
+            const std::string_view cached(mEntries[idx].path);
+            const bool matches = cached == path || (withChildren && cached.size() > path.size() && cached[path.size()] == '/' && cached.starts_with(path));
+            const int32_t next = mEntries[idx].lruNext;
+            if (matches) {
+                evictEntry(idx, out);
+            }
+            idx = next;
+        }
+    }
+
+    void evictAll(Evicted &out) {
+        std::lock_guard lock(mMutex);
+        while (mLruHead >= 0) {
+            evictEntry(mLruHead, out);
+        }
+    }
+
+private:
+    struct Entry {
+        FSAClientHandle clientHandle;
+        FSAFileHandle fd;
+        int32_t lruPrev;
+        int32_t lruNext;
+        char path[FS_MAX_PATH + 1];
+    };
+
+    // Unlinks the entry from the LRU list and puts it on the free list
+    void release(int32_t idx) {
+        auto &entry = mEntries[idx];
+        if (entry.lruPrev >= 0) {
+            mEntries[entry.lruPrev].lruNext = entry.lruNext;
+        } else {
+            mLruHead = entry.lruNext;
+        }
+        if (entry.lruNext >= 0) {
+            mEntries[entry.lruNext].lruPrev = entry.lruPrev;
+        } else {
+            mLruTail = entry.lruPrev;
+        }
+        entry.lruPrev = -1;
+        entry.lruNext = mFreeHead;
+        mFreeHead     = idx;
+        mCount--;
+    }
+
+    void evictEntry(int32_t idx, Evicted &out) {
+        out.handles[out.count++] = Handle{mEntries[idx].clientHandle, mEntries[idx].fd};
+        release(idx);
+    }
+
+    std::mutex mMutex;
+    Entry mEntries[FSA_MAX_CACHED_HANDLES]{};
+    // Index linked list of the parked handles, the head is the most recently parked one
+    int32_t mLruHead     = -1;
+    int32_t mLruTail     = -1;
+    int32_t mFreeHead    = -1;
+    uint32_t mCount      = 0;
+    uint32_t mMaxHandles = 0;
+};
+
+static void __fsa_handle_cache_close(__fsa_device_t *deviceData, const FSAHandleCache::Evicted &evicted) {
+    for (uint32_t i = 0; i < evicted.count; i++) {
+        const auto &handle   = evicted.handles[i];
+        const FSError status = FSACloseFile(handle.clientHandle, handle.fd);
+        if (status < 0) {
+            DEBUG_FUNCTION_LINE_WARN("FSACloseFile(0x%08X, 0x%08X) of a cached handle failed: %s",
+                                     handle.clientHandle, handle.fd, FSAGetStatusStr(status));
+        }
+        __fsa_release_client(deviceData, handle.clientHandle);
+    }
+}
+
+bool __fsa_handle_cache_configure(__fsa_device_t *deviceData, uint32_t maxHandles) {
+    if (!deviceData->handleCache) {
+        if (maxHandles == 0) {
+            return true;
+        }
+        // Is kept until the mount is removed, so running operations can't see it disappear.
+        deviceData->handleCache = new (std::nothrow) FSAHandleCache;
+        if (!deviceData->handleCache) {
+            return false;
+        }
+    }
+    FSAHandleCache::Evicted evicted;
+    deviceData->handleCache->configure(maxHandles, evicted);
+    deviceData->maxCachedHandles = maxHandles;
+    __fsa_handle_cache_close(deviceData, evicted);
+    return true;
+}
+
+void __fsa_handle_cache_free(__fsa_device_t *deviceData) {
+    if (!deviceData->handleCache) {
+        return;
+    }
+    __fsa_handle_cache_clear(deviceData);
+    delete deviceData->handleCache;
+    deviceData->handleCache = nullptr;
+}
+
+bool __fsa_handle_cache_take(__fsa_device_t *deviceData, const char *path, FSAClientHandle *outClientHandle, FSAFileHandle *outFd) {
+    return deviceData->handleCache && deviceData->handleCache->take(path, outClientHandle, outFd);
+}
+
+bool __fsa_handle_cache_put(__fsa_device_t *deviceData, const char *path, FSAClientHandle clientHandle, FSAFileHandle fd) {
+    if (!deviceData->handleCache) {
+        return false;
+    }
+    FSAHandleCache::Evicted evicted;
+    if (!deviceData->handleCache->put(path, clientHandle, fd, evicted)) {
+        return false;
+    }
+    __fsa_handle_cache_close(deviceData, evicted);
+    return true;
+}
+
+// Closes all cached handles, returns true if there were any.
+bool __fsa_handle_cache_clear(__fsa_device_t *deviceData) {
+    if (!deviceData->handleCache) {
+        return false;
+    }
+    FSAHandleCache::Evicted evicted;
+    deviceData->handleCache->evictAll(evicted);
+    __fsa_handle_cache_close(deviceData, evicted);
+    return evicted.count > 0;
+}
+
+void __fsa_handle_cache_evict(__fsa_device_t *deviceData, const char *path, bool withChildren) {
+    if (!deviceData->handleCache) {
+        return;
+    }
+    std::string_view view(path);
+    while (view.size() > 1 && view.ends_with('/')) {
+        view.remove_suffix(1);
+    }
+    FSAHandleCache::Evicted evicted;
+    deviceData->handleCache->evict(view, withChildren, evicted);
+    __fsa_handle_cache_close(deviceData, evicted);
+}
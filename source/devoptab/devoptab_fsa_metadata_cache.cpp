@@ -0,0 +1,351 @@
+#include "../logger.h"
+#include "devoptab_fsa.h"
+#include <coreinit/time.h>
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include <string_view>
+
+/**
+ * Remembers the result of FSAGetStat per path, including paths that don't exist.
+ * Entries expire after the TTL, the least recently used entry is dropped when the cache is full.
+ * All entries are allocated when the cache is configured, storing a path never allocates memory.
+ */
+class FSAMetadataCache {
+public:
+    ~FSAMetadataCache() {
+        release();
+    }
+
+    bool configure(uint32_t maxEntries, uint32_t ttlMs) {
+        std::lock_guard lock(mMutex);
+        release();
+        mTTL = (OSTime) OSMillisecondsToTicks(ttlMs);
+        if (maxEntries == 0) {
+            return true;
+        }
+
+        // Allocate the entries first, the bucket count can't overflow if they fit into memory
+        mEntries = new (std::nothrow) Entry[maxEntries];
+        if (mEntries) {
+            uint32_t numBuckets = 1;
+            while (numBuckets < maxEntries * 2) {
+                numBuckets <<= 1;
+            }
+            mBuckets    = new (std::nothrow) int32_t[numBuckets];
+            mNumBuckets = numBuckets;
+        }
+        if (!mEntries || !mBuckets) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to allocate metadata cache (%d entries)", maxEntries);
+            release();
+            return false;
+        }
+        mMaxEntries = maxEntries;
+
+        for (uint32_t i = 0; i < mNumBuckets; i++) {
+            mBuckets[i] = -1;
+        }
+        for (uint32_t i = 0; i < mMaxEntries; i++) {
+            auto &entry    = mEntries[i];
+            entry.valid    = false;
+            entry.hashNext = -1;
+            entry.lruPrev  = (int32_t) i - 1;
+            entry.lruNext  = (i + 1 < mMaxEntries) ? (int32_t) i + 1 : -1;
+        }
+        mLruHead = 0;
+        mLruTail = (int32_t) mMaxEntries - 1;
+        return true;
+    }
+
+    bool lookup(const char *path, FSAStat *outStat, bool *outExists) {
+        std::lock_guard lock(mMutex);
+        if (mMaxEntries == 0) {
+            return false;
+        }
+        const int32_t idx = find(path);
+        if (idx < 0) {
+            return false;
+        }
+        auto &entry = mEntries[idx];
+        if (OSGetTime() >= entry.expires) {
+            drop(idx);
+            return false;
+        }
+        lruUnlink(idx);
+        lruPushFront(idx);
+        *outExists = entry.exists;
+        if (entry.exists) {
+            *outStat = entry.stat;
+        }
+        return true;
+    }
+
+    // Changes whenever something has been invalidated
+    uint32_t generation() {
+        std::lock_guard lock(mMutex);
+        return mGeneration;
+    }
+
+    // Only stores the result if nothing has been invalidated since the lookup started (see generation).
+    void store(const char *path, const FSAStat *stat, uint32_t generation) {
+        std::lock_guard lock(mMutex);
+        if (mMaxEntries == 0 || generation != mGeneration) {
+            return;
+        }
+        const std::string_view view(path);
+        if (view.size() > FS_MAX_PATH) {
+            return;
+        }
+        int32_t idx = find(view);
+        if (idx < 0) {
+            // Reuse the least recently used entry, dropped entries are moved to the back
+            idx = mLruTail;
+            if (mEntries[idx].valid) {
+                hashRemove(idx);
+            }
+            auto &entry = mEntries[idx];
+            memcpy(entry.path, view.data(), view.size());
+            entry.path[view.size()] = '\0';
+            entry.hash              = hashPath(view);
+            entry.valid             = true;
+            hashInsert(idx);
+        }
+        lruUnlink(idx);
+        lruPushFront(idx);
+
+        auto &entry   = mEntries[idx];
+        entry.exists  = stat != nullptr;
+        entry.expires = OSGetTime() + mTTL;
+        if (stat) {
+            entry.stat = *stat;
+        }
+    }
+
+    void invalidate(std::string_view path, bool withChildren) {
+        std::lock_guard lock(mMutex);
+        mGeneration++;
+        if (mMaxEntries == 0) {
+            return;
+        }
+        if (const int32_t idx = find(path); idx >= 0) {
+            drop(idx);
+        }
+        if (!withChildren) {
+            return;
+        }
+        for (uint32_t i = 0; i < mMaxEntries; i++) {
+            const auto &entry = mEntries[i];
+            if (!entry.valid) {
+                continue;
+            }
+            const std::string_view key(entry.path);
+            if (key.size() > path.size() && key[path.size()] == '/' && key.starts_with(path)) {
+                drop((int32_t) i);
+            }
+        }
+    }
+
+private:
+    struct Entry {
+        bool valid;
+        bool exists;
+        uint32_t hash;
+        int32_t hashNext;
+        int32_t lruPrev;
+        int32_t lruNext;
+        OSTime expires;
+        FSAStat stat;
+        char path[FS_MAX_PATH + 1];
+    };
+
+    static uint32_t hashPath(std::string_view path) {
+        uint32_t h = 0;
+        for (const char c : path) {
+            h = 37 * h + (uint8_t) c;
+        }
+        return h;
+    }
+
+    [[nodiscard]] uint32_t hashBucket(uint32_t hash) const { return (hash * 2654435761u) & (mNumBuckets - 1); }
+
+    void release() {
+        delete[] mEntries;
+        delete[] mBuckets;
+        mEntries    = nullptr;
+        mBuckets    = nullptr;
+        mNumBuckets = 0;
+        mMaxEntries = 0;
+        mLruHead    = -1;
+        mLruTail    = -1;
+    }
+
+    int32_t find(std::string_view path) const {
+        const uint32_t hash = hashPath(path);
+        for (int32_t idx = mBuckets[hashBucket(hash)]; idx >= 0; idx = mEntries[idx].hashNext) {
+            if (mEntries[idx].hash == hash && path == mEntries[idx].path) {
+                return idx;
+            }
+        }
+        return -1;
+    }
+
+    void hashInsert(int32_t idx) {
+        auto &bucket           = mBuckets[hashBucket(mEntries[idx].hash)];
+        mEntries[idx].hashNext = bucket;
+        bucket                 = idx;
+    }
+
+    void hashRemove(int32_t idx) {
+        int32_t *cur = &mBuckets[hashBucket(mEntries[idx].hash)];
+        while (*cur >= 0) {
+            if (*cur == idx) {
+                *cur = mEntries[idx].hashNext;
+                break;
+            }
+            cur = &mEntries[*cur].hashNext;
+        }
+        mEntries[idx].hashNext = -1;
+    }
+
+    void lruUnlink(int32_t idx) {
+        auto &entry = mEntries[idx];
+        if (entry.lruPrev >= 0) {
+            mEntries[entry.lruPrev].lruNext = entry.lruNext;
+        } else {
+            mLruHead = entry.lruNext;
+        }
+        if (entry.lruNext >= 0) {
+            mEntries[entry.lruNext].lruPrev = entry.lruPrev;
+        } else {
+            mLruTail = entry.lruPrev;
+        }
+        entry.lruPrev = -1;
+        entry.lruNext = -1;
+    }
+
+    void lruPushFront(int32_t idx) {
+        auto &entry   = mEntries[idx];
+        entry.lruPrev = -1;
+        entry.lruNext = mLruHead;
+        if (mLruHead >= 0) {
+            mEntries[mLruHead].lruPrev = idx;
+        } else {
+            mLruTail = idx;
+        }
+        mLruHead = idx;
+    }
+
+    void lruPushBack(int32_t idx) {
+        auto &entry   = mEntries[idx];
+        entry.lruPrev = mLruTail;
+        entry.lruNext = -1;
+        if (mLruTail >= 0) {
+            mEntries[mLruTail].lruNext = idx;
+        } else {
+            mLruHead = idx;
+        }
+        mLruTail = idx;
+    }
+
+    // Frees the entry and moves it to the back of the LRU list, so it's reused first
+    void drop(int32_t idx) {
+        hashRemove(idx);
+        mEntries[idx].valid = false;
+        lruUnlink(idx);
+        lruPushBack(idx);
+    }
+
+    std::mutex mMutex;
+    Entry *mEntries      = nullptr;
+    int32_t *mBuckets    = nullptr;
+    uint32_t mNumBuckets = 0;
+    uint32_t mMaxEntries = 0;
+    uint32_t mGeneration = 0;
+    int32_t mLruHead     = -1;
+    int32_t mLruTail     = -1;
+    OSTime mTTL          = 0;
+};
+
+bool __fsa_metadata_cache_configure(__fsa_device_t *deviceData, uint32_t maxEntries, uint32_t ttlMs) {
+    if (!deviceData->metadataCache) {
+        if (maxEntries == 0) {
+            return true;
+        }
+        // Is kept until the mount is removed, so running operations can't see it disappear.
+        deviceData->metadataCache = new (std::nothrow) FSAMetadataCache;
+        if (!deviceData->metadataCache) {
+            return false;
+        }
+    }
+    if (!deviceData->metadataCache->configure(maxEntries, ttlMs)) {
+        deviceData->metadataCacheEntries = 0;
+        return false;
+    }
+    deviceData->metadataCacheEntries = maxEntries;
+    deviceData->metadataCacheTTL     = ttlMs;
+    return true;
+}
+
+void __fsa_metadata_cache_free(__fsa_device_t *deviceData) {
+    delete deviceData->metadataCache;
+    deviceData->metadataCache = nullptr;
+}
+
+FSError
+__fsa_get_stat_cached(const __fsa_device_t *deviceData, FSAClientHandle clientHandle, const char *path, FSAStat *outStat) {
+    auto *cache = deviceData->metadataCache;
+    if (!cache) {
+        return FSAGetStat(clientHandle, path, outStat);
+    }
+
+    bool exists;
+    if (cache->lookup(path, outStat, &exists)) {
+        return exists ? FS_ERROR_OK : FS_ERROR_NOT_FOUND;
+    }
+
+    const uint32_t generation = cache->generation();
+    const FSError status      = FSAGetStat(clientHandle, path, outStat);
+    if (status == FS_ERROR_OK) {
+        cache->store(path, outStat, generation);
+    } else if (status == FS_ERROR_NOT_FOUND) {
+        cache->store(path, nullptr, generation);
+    }
+    return status;
+}
+
+uint32_t __fsa_metadata_cache_generation(const __fsa_device_t *deviceData) {
+    return deviceData->metadataCache ? deviceData->metadataCache->generation() : 0;
+}
+
+void __fsa_metadata_cache_prime(const __fsa_device_t *deviceData, const char *dirPath, const char *name, const FSAStat *stat, uint32_t generation) {
+    if (!deviceData->metadataCache || deviceData->metadataCacheEntries == 0) {
+        return;
+    }
+    char path[FS_MAX_PATH + 1];
+    if (snprintf(path, sizeof(path), "%s/%s", dirPath, name) >= (int) sizeof(path)) {
+        return;
+    }
+    deviceData->metadataCache->store(path, stat, generation);
+}
+
+bool __fsa_metadata_cache_known_missing(const __fsa_device_t *deviceData, const char *path) {
+    FSAStat stat;
+    bool exists;
+    return deviceData->metadataCache && deviceData->metadataCache->lookup(path, &stat, &exists) && !exists;
+}
+
+void __fsa_metadata_cache_invalidate(const __fsa_device_t *deviceData, const char *path, bool withChildren) {
+    if (!deviceData->metadataCache) {
+        return;
+    }
+    std::string_view view(path);
+    while (view.size() > 1 && view.ends_with('/')) {
+        view.remove_suffix(1);
+    }
+    deviceData->metadataCache->invalidate(view, withChildren);
+
+    // Creating or removing an entry changes the parent directory too
+    if (const auto pos = view.rfind('/'); pos != std::string_view::npos && pos > 0) {
+        deviceData->metadataCache->invalidate(view.substr(0, pos), false);
+    }
+}
@@ -10,9 +10,8 @@ int __fsa_mkdir(struct _reent *r,
         return -1;
     }
 
-    char *fixedPath = __fsa_fixpath(r, path);
-    if (!fixedPath) {
-        r->_errno = ENOMEM;
+    char fixedPath[FS_MAX_PATH + 1];
+    if (!__fsa_fixpath(r, path, fixedPath)) {
         return -1;
     }
 
@@ -20,15 +19,15 @@ int __fsa_mkdir(struct _reent *r,
 
     const FSMode translatedMode = __fsa_translate_permission_mode(mode);
 
-    const FSError status = FSAMakeDir(deviceData->clientHandle, fixedPath, translatedMode);
+    FSAClientLease client(deviceData);
+    const FSError status = FSAMakeDir(client.handle(), fixedPath, translatedMode);
+    __fsa_invalidate_path(deviceData, fixedPath, false);
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSAMakeDir(0x%08X, %s, 0x%X) failed: %s",
-                                deviceData->clientHandle, fixedPath, translatedMode, FSAGetStatusStr(status));
-        free(fixedPath);
+                                client.handle(), fixedPath, translatedMode, FSAGetStatusStr(status));
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
-    free(fixedPath);
 
     return 0;
 }
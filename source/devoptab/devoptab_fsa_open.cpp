@@ -1,5 +1,7 @@
 #include "../logger.h"
+#include "../utils.h"
 #include "devoptab_fsa.h"
+#include "mocha/mocha.h"
 #include <mutex>
 
 // Extended "magic" value that allows opening files with FS_OPEN_FLAG_UNENCRYPTED in underlying FSOpenFileEx() call similar to O_DIRECTORY
@@ -66,52 +68,54 @@ int __fsa_open(struct _reent *r,
         return -1;
     }
 
-    char *fixedPath = __fsa_fixpath(r, path);
-    if (!fixedPath) {
-        r->_errno = ENOMEM;
-        return -1;
-    }
-
-
     auto *file            = static_cast<__fsa_file_t *>(fileStruct);
     const auto deviceData = static_cast<__fsa_device_t *>(r->deviceData);
 
-    if (snprintf(file->fullPath, sizeof(file->fullPath), "%s", fixedPath) >= (int) sizeof(file->fullPath)) {
-        DEBUG_FUNCTION_LINE_ERR("__fsa_open: snprintf result was truncated");
+    if (!__fsa_fixpath(r, path, file->fullPath)) {
+        return -1;
     }
-    free(fixedPath);
 
     // Prepare flags
     FSOpenFileFlags openFlags = (flags & O_UNENCRYPTED) ? FS_OPEN_FLAG_UNENCRYPTED : FS_OPEN_FLAG_NONE;
     FSMode translatedMode     = __fsa_translate_permission_mode(mode);
     uint32_t preAllocSize     = 0;
+    if ((flags & O_PREALLOCATE) && (flags & O_ACCMODE) != O_RDONLY && deviceData->preallocSize > 0) {
+        openFlags    = static_cast<FSOpenFileFlags>(openFlags | FS_OPEN_FLAG_PREALLOC_SIZE);
+        preAllocSize = deviceData->preallocSize;
+    }
 
     // Init mutex and lock
     file->mutex.init(file->fullPath);
     std::scoped_lock lock(file->mutex);
 
-    if (createFileIfNotFound || failIfFileNotFound || (flags & (O_EXCL | O_CREAT)) == (O_EXCL | O_CREAT)) {
-        // Check if file exists
-        FSAStat stat;
-        status = FSAGetStat(deviceData->clientHandle, file->fullPath, &stat);
+    // The files of a mount with virtualized handles give their FSA handle back when other files need it
+    file->virtualized = deviceData->maxOpenFiles > 0;
+    file->handleOpen  = false;
+    file->listed      = false;
+    file->pins        = 0;
+    file->prevOpen    = nullptr;
+    file->nextOpen    = nullptr;
+
+    // Plain read-only files can reuse a handle that has been kept open by the handle cache
+    const bool cacheHandle = (flags & O_ACCMODE) == O_RDONLY && openFlags == FS_OPEN_FLAG_NONE;
+    FSAClientHandle cachedClient;
+    const bool fromCache = cacheHandle && __fsa_handle_cache_take(deviceData, file->fullPath, &cachedClient, &fd);
+    if ((flags & O_ACCMODE) != O_RDONLY) {
+        // Files kept open by the handle cache can't be opened for writing
+        __fsa_handle_cache_evict(deviceData, file->fullPath, false);
+    }
+
+    // The file stays on this client until it's closed
+    FSAClientLease client = fromCache ? FSAClientLease(deviceData, cachedClient) : FSAClientLease(deviceData);
+
+    // Only check if the file exists if the open itself can't tell. The result decides whether the file may be
+    // created or truncated, so it has to come from the filesystem and not from the metadata cache.
+    FSAStat stat;
+    bool freshStat = false;
+    if (failIfFileNotFound || (flags & (O_EXCL | O_CREAT)) == (O_EXCL | O_CREAT)) {
+        status = FSAGetStat(client.handle(), file->fullPath, &stat);
         if (status == FS_ERROR_NOT_FOUND) {
-            if (createFileIfNotFound) { // Create new file if needed
-                status = FSAOpenFileEx(deviceData->clientHandle, file->fullPath, "w", translatedMode,
-                                       openFlags, preAllocSize, &fd);
-                if (status == FS_ERROR_OK) {
-                    if (FSACloseFile(deviceData->clientHandle, fd) != FS_ERROR_OK) {
-                        DEBUG_FUNCTION_LINE_ERR("FSACloseFile(0x%08X, 0x%08X) (%s) failed: %s",
-                                                deviceData->clientHandle, fd, file->fullPath, FSAGetStatusStr(status));
-                    }
-                    fd = -1;
-                } else {
-                    DEBUG_FUNCTION_LINE_ERR("FSAOpenFileEx(0x%08X, %s, %s, 0x%X, 0x%08X, 0x%08X, %p) failed: %s",
-                                            deviceData->clientHandle, file->fullPath, "w", translatedMode, openFlags, preAllocSize, &fd,
-                                            FSAGetStatusStr(status));
-                    r->_errno = __fsa_translate_error(status);
-                    return -1;
-                }
-            } else if (failIfFileNotFound) { // Return an error if we don't we create new files
+            if (failIfFileNotFound) { // Return an error if we don't we create new files
                 r->_errno = __fsa_translate_error(status);
                 return -1;
             }
@@ -121,39 +125,93 @@ int __fsa_open(struct _reent *r,
                 r->_errno = EEXIST;
                 return -1;
             }
+            freshStat = true;
         }
     }
 
-    status = FSAOpenFileEx(deviceData->clientHandle, file->fullPath, fsMode, translatedMode, openFlags, preAllocSize, &fd);
+    if (fromCache) {
+        status = FS_ERROR_OK;
+    } else {
+        status = __fsa_open_file_handle(deviceData, file, client.handle(), fsMode, translatedMode, openFlags, preAllocSize, &fd);
+        if (status == FS_ERROR_NOT_FOUND && createFileIfNotFound) {
+            // The file doesn't exist, so it can be created with a mode that truncates it.
+            fsMode = "w+";
+            status = __fsa_open_file_handle(deviceData, file, client.handle(), fsMode, translatedMode, openFlags, preAllocSize, &fd);
+        }
+    }
     if (status < 0) {
         if (status != FS_ERROR_NOT_FOUND) {
             DEBUG_FUNCTION_LINE_ERR("FSAOpenFileEx(0x%08X, %s, %s, 0x%X, 0x%08X, 0x%08X, %p) failed: %s",
-                                    deviceData->clientHandle, file->fullPath, fsMode, translatedMode, openFlags, preAllocSize, &fd,
+                                    client.handle(), file->fullPath, fsMode, translatedMode, openFlags, preAllocSize, &fd,
                                     FSAGetStatusStr(status));
         }
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
 
-    file->fd    = fd;
-    file->flags = (flags & (O_ACCMODE | O_APPEND | O_SYNC));
+    // The file might have been created or truncated
+    if ((flags & O_ACCMODE) != O_RDONLY) {
+        __fsa_invalidate_path(deviceData, file->fullPath, false);
+    }
+
+    file->fd         = fd;
+    file->handleOpen = true;
+    file->flags      = (flags & (O_ACCMODE | O_APPEND | O_SYNC));
     // Is always 0, even if O_APPEND is set.
     file->offset = 0;
 
+    file->readBuffer       = nullptr;
+    file->readBufferSize   = ((flags & O_ACCMODE) != O_WRONLY) ? ROUNDUP(deviceData->readAheadSize, 0x40) : 0;
+    file->readBufferOffset = 0;
+    file->readBufferLength = 0;
+
+    file->writeBuffer       = nullptr;
+    file->writeBufferSize   = ((flags & O_ACCMODE) != O_RDONLY) ? ROUNDUP(deviceData->writeBufferSize, 0x40) : 0;
+    file->writeBufferLength = 0;
+
+    file->statValid   = false;
+    file->sizeValid   = false;
+    file->cacheStat   = deviceData->cacheFileStat && !(flags & O_SYNC);
+    file->cacheHandle = cacheHandle;
+
+    // Reopening the handle must not truncate the file
+    if ((flags & O_ACCMODE) == O_RDONLY) {
+        file->reopenMode = "r";
+    } else if (flags & O_APPEND) {
+        file->reopenMode = ((flags & O_ACCMODE) == O_RDWR) ? "a+" : "a";
+    } else {
+        file->reopenMode = "r+";
+    }
+    file->permissions = translatedMode;
+    file->openFlags   = static_cast<FSOpenFileFlags>(openFlags & ~FS_OPEN_FLAG_PREALLOC_SIZE);
+
+    if (fsMode[0] == 'w' && preAllocSize == 0) {
+        // The file has just been created or truncated, the preallocation isn't guaranteed to leave the size alone
+        file->stat.size = 0;
+        file->sizeValid = file->cacheStat;
+    } else if (freshStat) {
+        // Seeds the size for O_APPEND, so this must only ever be a stat that has just been read from the filesystem
+        file->stat      = stat;
+        file->statValid = file->cacheStat;
+        file->sizeValid = file->cacheStat;
+    }
+
+    file->clientHandle = client.handle();
     if (flags & O_APPEND) {
-        FSAStat stat;
-        status = FSAGetStatFile(deviceData->clientHandle, fd, &stat);
+        // Only asks the filesystem if the size isn't known already
+        status = __fsa_update_file_stat(deviceData, file, true);
         if (status < 0) {
-            DEBUG_FUNCTION_LINE_ERR("FSAGetStatFile(0x%08X, 0x%08X, %p) (%s) failed: %s",
-                                    deviceData->clientHandle, fd, &stat, file->fullPath, FSAGetStatusStr(status));
             r->_errno = __fsa_translate_error(status);
-            if (FSACloseFile(deviceData->clientHandle, fd) < 0) {
+            if (FSACloseFile(client.handle(), fd) < 0) {
                 DEBUG_FUNCTION_LINE_ERR("FSACloseFile(0x%08X, 0x%08X) (%s) failed: %s",
-                                        deviceData->clientHandle, fd, file->fullPath, FSAGetStatusStr(status));
+                                        client.handle(), fd, file->fullPath, FSAGetStatusStr(status));
             }
             return -1;
         }
-        file->appendOffset = stat.size;
+        file->appendOffset = file->stat.size;
     }
+
+    __fsa_register_file_handle(deviceData, file);
+    client.detach();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "../fsa_shim_pool.h"
+#include "../logger.h"
+#include "devoptab_fsa.h"
+#include <coreinit/ios.h>
+#include <coreinit/messagequeue.h>
+
+// Maximum number of requests in flight
+#define FSA_PIPELINE_MAX_DEPTH 8
+
+namespace {
+    struct PipelineRequest {
+        FSAShimBuffer *shim;
+        OSMessageQueue *queue;
+        OSMessage message;
+        uint32_t size;
+    };
+
+    // Called by the IPC driver once IOSU replied, don't do anything here that might block.
+    void PipelineCallback(IOSError error, void *context) {
+        auto *request            = static_cast<PipelineRequest *>(context);
+        request->message.message = request;
+        request->message.args[0] = static_cast<uint32_t>(error);
+        OSSendMessage(request->queue, &request->message, OS_MESSAGE_FLAGS_NONE);
+    }
+
+    FSError SubmitChunk(PipelineRequest *request, FSAClientHandle clientHandle, FSAFileHandle fd, FSACommandEnum command, uint8_t *buffer, uint32_t size, uint32_t pos) {
+        request->shim = FSAShimPool_Acquire(clientHandle, command);
+        if (!request->shim) {
+            return FS_ERROR_OUT_OF_RESOURCES;
+        }
+        request->size = size;
+
+        auto *shim               = request->shim;
+        shim->ioctlvVec[1].vaddr = buffer;
+        shim->ioctlvVec[1].len   = size;
+
+        if (command == FSA_COMMAND_READ_FILE) {
+            auto &readRequest     = shim->request.readFile;
+            readRequest.buffer    = buffer;
+            readRequest.size      = 1;
+            readRequest.count     = size;
+            readRequest.pos       = pos;
+            readRequest.handle    = fd;
+            readRequest.readFlags = FSA_READ_FLAG_READ_WITH_POS;
+        } else {
+            auto &writeRequest      = shim->request.writeFile;
+            writeRequest.buffer     = buffer;
+            writeRequest.size       = 1;
+            writeRequest.count      = size;
+            writeRequest.pos        = pos;
+            writeRequest.handle     = fd;
+            writeRequest.writeFlags = FSA_WRITE_FLAG_READ_WITH_POS;
+        }
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waddress-of-packed-member"
+        auto res = IOS_IoctlvAsync(shim->clientHandle, shim->command, shim->ioctlvVecIn, shim->ioctlvVecOut, shim->ioctlvVec, PipelineCallback, request);
+#pragma GCC diagnostic pop
+        if (res < 0) {
+            FSAShimPool_Release(shim);
+            request->shim = nullptr;
+            return __FSAShimDecodeIosErrorToFsaStatus(clientHandle, res);
+        }
+        return FS_ERROR_OK;
+    }
+} // namespace
+
+FSError
+__fsa_transfer_pipelined(FSAClientHandle clientHandle, __fsa_file_t *file, FSACommandEnum command, uint8_t *buffer, uint32_t size, uint32_t pos, uint32_t chunkSize, uint32_t depth) {
+    if (depth < 1) {
+        depth = 1;
+    } else if (depth > FSA_PIPELINE_MAX_DEPTH) {
+        depth = FSA_PIPELINE_MAX_DEPTH;
+    }
+
+    PipelineRequest requests[FSA_PIPELINE_MAX_DEPTH]{};
+    OSMessage messages[FSA_PIPELINE_MAX_DEPTH];
+    OSMessageQueue queue;
+    OSInitMessageQueue(&queue, messages, FSA_PIPELINE_MAX_DEPTH);
+
+    uint32_t submitted = 0; // bytes that have been submitted
+    uint32_t completed = 0; // bytes that have been transferred in order
+    uint32_t inFlight  = 0;
+    uint32_t next      = 0; // index of the next free request slot
+    uint32_t head      = 0; // index of the oldest request in flight
+    bool stop          = false;
+    FSError result     = FS_ERROR_OK;
+
+    // Results can arrive out of order, remember them until all previous chunks are done.
+    FSError results[FSA_PIPELINE_MAX_DEPTH];
+    bool done[FSA_PIPELINE_MAX_DEPTH]{};
+
+    while (true) {
+        while (!stop && inFlight < depth && submitted < size) {
+            const uint32_t chunk = MIN(size - submitted, chunkSize);
+            auto &request        = requests[next];
+            request.queue        = &queue;
+            FSError res          = SubmitChunk(&request, clientHandle, file->fd, command, buffer + submitted, chunk, pos + submitted);
+            if (res < 0) {
+                DEBUG_FUNCTION_LINE_ERR("Failed to submit %s of 0x%08X bytes (%s): %s", command == FSA_COMMAND_READ_FILE ? "read" : "write", chunk, file->fullPath, FSAGetStatusStr(res));
+                if (inFlight == 0 && completed == 0) {
+                    result = res;
+                }
+                stop = true;
+                break;
+            }
+            done[next] = false;
+            submitted += chunk;
+            next = (next + 1) % depth;
+            inFlight++;
+        }
+
+        if (inFlight == 0) {
+            break;
+        }
+
+        OSMessage message;
+        OSReceiveMessage(&queue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+        auto *request    = static_cast<PipelineRequest *>(message.message);
+        const auto index = request - requests;
+        FSAShimPool_Release(request->shim);
+        request->shim  = nullptr;
+        // Decode the IOS error the same way __FSAShimSend does for synchronous requests
+        results[index] = __FSAShimDecodeIosErrorToFsaStatus(clientHandle, static_cast<IOSError>(message.args[0]));
+        done[index]    = true;
+
+        // Account all chunks that are done in submission order
+        while (inFlight > 0 && done[head]) {
+            const FSError res = results[head];
+            done[head]        = false;
+            inFlight--;
+            if (!stop) {
+                if (res < 0) {
+                    DEBUG_FUNCTION_LINE_ERR("FSA %s of 0x%08X bytes at 0x%08X (%s) failed: %s", command == FSA_COMMAND_READ_FILE ? "read" : "write",
+                                            requests[head].size, pos + completed, file->fullPath, FSAGetStatusStr(res));
+                    if (completed == 0) {
+                        result = res;
+                    }
+                    stop = true;
+                } else {
+                    completed += res;
+                    if ((uint32_t) res != requests[head].size) {
+                        stop = true; // partial transfer, ignore everything behind it
+                    }
+                }
+            }
+            head = (head + 1) % depth;
+        }
+    }
+
+    if (result < 0) {
+        return result;
+    }
+    return static_cast<FSError>(completed);
+}
@@ -0,0 +1,368 @@
+#include "../logger.h"
+#include "../utils.h"
+#include "devoptab_fsa.h"
+#include "mocha/mocha.h"
+#include <memory>
+#include <mutex>
+
+// Looks up the FSA file and mount behind a newlib file descriptor, sets errno on error.
+static __fsa_file_t *__fsa_get_file(int fd, __fsa_device_t **outDeviceData) {
+    __handle *handle = __get_handle(fd);
+    if (!handle || !handle->fileStruct) {
+        errno = EBADF;
+        return nullptr;
+    }
+    const devoptab_t *device = devoptab_list[handle->device];
+    if (!device || device->open_r != __fsa_open || !device->deviceData) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    *outDeviceData = static_cast<__fsa_device_t *>(device->deviceData);
+    return static_cast<__fsa_file_t *>(handle->fileStruct);
+}
+
+// Makes sure the buffers of the file are consistent with a positional transfer. The lock is only held for this,
+// the transfer itself doesn't touch the state of the file. Pins the FSA handle until __fsa_end_positional.
+static bool __fsa_prepare_positional(__fsa_device_t *deviceData, __fsa_file_t *file, bool write) {
+    std::scoped_lock lock(file->mutex);
+
+    FSError status = __fsa_flush_write_buffer(deviceData, file);
+    if (status >= 0) {
+        status = __fsa_pin_file_handle(deviceData, file);
+    }
+    if (status < 0) {
+        errno = __fsa_translate_error(status);
+        return false;
+    }
+    if (write) {
+        __fsa_drop_readahead(file);
+    }
+    return true;
+}
+
+// Transfers len bytes at pos without using or changing the offset of the file.
+// Returns the number of bytes that have been transferred, or the error of the first request.
+static FSError __fsa_transfer_at(__fsa_device_t *deviceData, __fsa_file_t *file, FSACommandEnum command, uint8_t *ptr, uint32_t len, uint32_t pos) {
+    // cache-aligned, cache-line-sized
+    __attribute__((aligned(0x40))) uint8_t alignedBuffer[0x40];
+
+    const bool write         = command == FSA_COMMAND_WRITE_FILE;
+    const uint32_t chunkSize = write ? deviceData->writeChunkSize : deviceData->readChunkSize;
+
+    uint32_t done = 0;
+    while (done < len) {
+        // only use input buffer if cache-aligned and the size is a multiple of cache line size
+        uint8_t *tmp  = ptr + done;
+        uint32_t size = len - done;
+
+        if (size < 0x40) {
+            // partial cache-line back-end
+            tmp = alignedBuffer;
+        } else if ((uintptr_t) tmp & 0x3F) {
+            // partial cache-line front-end
+            size = MIN(size, 0x40 - ((uintptr_t) tmp & 0x3F));
+            tmp  = alignedBuffer;
+        } else {
+            // whole cache lines
+            size &= ~0x3F;
+        }
+
+        FSError status;
+        if (size > chunkSize) {
+            status = __fsa_transfer_pipelined(file->clientHandle, file, command, tmp, size, pos + done, chunkSize, deviceData->pipelineDepth);
+        } else if (write) {
+            if (tmp == alignedBuffer) {
+                memcpy(alignedBuffer, ptr + done, size);
+            }
+            status = FSAWriteFileWithPos(file->clientHandle, tmp, 1, size, pos + done, file->fd, FSA_WRITE_FLAG_READ_WITH_POS);
+            if (status < 0) {
+                DEBUG_FUNCTION_LINE_ERR("FSAWriteFileWithPos(0x%08X, %p, 1, 0x%08X, 0x%08X, 0x%08X) (%s) failed: %s",
+                                        file->clientHandle, tmp, size, pos + done, file->fd, file->fullPath, FSAGetStatusStr(status));
+            }
+        } else {
+            status = FSAReadFileWithPos(file->clientHandle, tmp, 1, size, pos + done, file->fd, FSA_READ_FLAG_READ_WITH_POS);
+            if (status < 0) {
+                DEBUG_FUNCTION_LINE_ERR("FSAReadFileWithPos(0x%08X, %p, 1, 0x%08X, 0x%08X, 0x%08X) (%s) failed: %s",
+                                        file->clientHandle, tmp, size, pos + done, file->fd, file->fullPath, FSAGetStatusStr(status));
+            }
+        }
+
+        if (status < 0) {
+            return done > 0 ? static_cast<FSError>(done) : status;
+        }
+
+        if (!write && tmp == alignedBuffer) {
+            memcpy(ptr + done, alignedBuffer, status);
+        }
+        done += status;
+
+        if ((uint32_t) status != size) {
+            break; // partial transfer
+        }
+    }
+    return static_cast<FSError>(done);
+}
+
+// Validates the arguments of a positional transfer and clamps len to what can be transferred and returned.
+static __fsa_file_t *__fsa_begin_positional(int fd, bool write, size_t *len, off_t offset, __fsa_device_t **outDeviceData) {
+    __fsa_file_t *file = __fsa_get_file(fd, outDeviceData);
+    if (!file) {
+        return nullptr;
+    }
+    if ((file->flags & O_ACCMODE) == (write ? O_RDONLY : O_WRONLY)) {
+        errno = EBADF;
+        return nullptr;
+    }
+    // FSA ignores the position of writes to files opened for appending, the data would end up at the end of the file.
+    if (write && (file->flags & O_APPEND)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    if (offset < 0 || offset > UINT32_MAX) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    *len = MIN(*len, MIN((size_t) SSIZE_MAX, UINT32_MAX - (uint32_t) offset));
+    if (!__fsa_prepare_positional(*outDeviceData, file, write)) {
+        return nullptr;
+    }
+    return file;
+}
+
+// Unpins the handle only after the size has been updated, Mocha_FSPAllocate relies on it once the file is unpinned.
+static ssize_t __fsa_end_positional(__fsa_device_t *deviceData, __fsa_file_t *file, bool write, FSError status, off_t offset) {
+    if (write && status > 0) {
+        std::scoped_lock lock(file->mutex);
+        // Reads that ran in parallel might have buffered the old data
+        __fsa_drop_readahead(file);
+        if ((uint32_t) offset + status > file->appendOffset) {
+            file->appendOffset = (uint32_t) offset + status;
+        }
+        __fsa_update_cached_size(file, (uint32_t) offset + status);
+        __fsa_invalidate_path(deviceData, file->fullPath, false);
+    }
+    __fsa_unpin_file_handle(deviceData, file);
+    if (status < 0) {
+        errno = __fsa_translate_error(status);
+        return -1;
+    }
+    return status;
+}
+
+ssize_t Mocha_FSPRead(int fd, void *buf, size_t count, off_t offset) {
+    if (!buf) {
+        errno = EINVAL;
+        return -1;
+    }
+    __fsa_device_t *deviceData;
+    __fsa_file_t *file = __fsa_begin_positional(fd, false, &count, offset, &deviceData);
+    if (!file) {
+        return -1;
+    }
+    const FSError status = __fsa_transfer_at(deviceData, file, FSA_COMMAND_READ_FILE, (uint8_t *) buf, count, offset);
+    return __fsa_end_positional(deviceData, file, false, status, offset);
+}
+
+ssize_t Mocha_FSPWrite(int fd, const void *buf, size_t count, off_t offset) {
+    if (!buf) {
+        errno = EINVAL;
+        return -1;
+    }
+    __fsa_device_t *deviceData;
+    __fsa_file_t *file = __fsa_begin_positional(fd, true, &count, offset, &deviceData);
+    if (!file) {
+        return -1;
+    }
+    const FSError status = __fsa_transfer_at(deviceData, file, FSA_COMMAND_WRITE_FILE, (uint8_t *) buf, count, offset);
+    return __fsa_end_positional(deviceData, file, true, status, offset);
+}
+
+// Sums up the sizes of the buffers, returns false if the total doesn't fit into a ssize_t.
+static bool __fsa_iov_size(const MochaFSIOVec *iov, int iovcnt, size_t *outSize) {
+    if (!iov || iovcnt < 0) {
+        return false;
+    }
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (!iov[i].base && iov[i].len > 0) {
+            return false;
+        }
+        if (iov[i].len > SSIZE_MAX - total) {
+            return false;
+        }
+        total += iov[i].len;
+    }
+    *outSize = total;
+    return true;
+}
+
+// Position in a list of buffers
+struct __fsa_iov_cursor_t {
+    const MochaFSIOVec *iov;
+    int index;
+    size_t offset;
+};
+
+// Copies len bytes between the buffers at the cursor and buffer, in the direction given by toIov, and advances the cursor.
+static void __fsa_iov_copy(__fsa_iov_cursor_t *cursor, uint8_t *buffer, size_t len, bool toIov) {
+    while (len > 0) {
+        const MochaFSIOVec &vec = cursor->iov[cursor->index];
+        if (cursor->offset == vec.len) {
+            cursor->index++;
+            cursor->offset = 0;
+            continue;
+        }
+        const size_t size = MIN(len, vec.len - cursor->offset);
+        if (toIov) {
+            memcpy((uint8_t *) vec.base + cursor->offset, buffer, size);
+        } else {
+            memcpy(buffer, (const uint8_t *) vec.base + cursor->offset, size);
+        }
+        cursor->offset += size;
+        buffer += size;
+        len -= size;
+    }
+}
+
+static ssize_t __fsa_transfer_vectored(int fd, const MochaFSIOVec *iov, int iovcnt, off_t offset, bool write) {
+    size_t total;
+    if (!__fsa_iov_size(iov, iovcnt, &total)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (iovcnt == 1) {
+        return write ? Mocha_FSPWrite(fd, iov[0].base, iov[0].len, offset) : Mocha_FSPRead(fd, iov[0].base, iov[0].len, offset);
+    }
+
+    __fsa_device_t *deviceData;
+    __fsa_file_t *file = __fsa_begin_positional(fd, write, &total, offset, &deviceData);
+    if (!file) {
+        return -1;
+    }
+
+    // Stage the data in chunks of up to one request. This avoids the partial cache-lines of every single buffer
+    // without allocating the whole transfer at once.
+    const uint32_t chunkSize   = write ? deviceData->writeChunkSize : deviceData->readChunkSize;
+    const uint32_t stagingSize = MIN(total, chunkSize);
+    std::unique_ptr<uint8_t, decltype(&free)> buffer((uint8_t *) memalign(0x40, ROUNDUP(MAX(stagingSize, 1), 0x40)), free);
+    if (!buffer) {
+        __fsa_unpin_file_handle(deviceData, file);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    __fsa_iov_cursor_t cursor = {iov, 0, 0};
+    const auto command        = write ? FSA_COMMAND_WRITE_FILE : FSA_COMMAND_READ_FILE;
+    uint32_t done             = 0;
+    FSError status            = FS_ERROR_OK;
+    while (done < total) {
+        const uint32_t size = MIN(total - done, stagingSize);
+        if (write) {
+            __fsa_iov_copy(&cursor, buffer.get(), size, false);
+        }
+        status = __fsa_transfer_at(deviceData, file, command, buffer.get(), size, (uint32_t) offset + done);
+        if (status < 0) {
+            break;
+        }
+        if (!write) {
+            __fsa_iov_copy(&cursor, buffer.get(), status, true);
+        }
+        done += status;
+        if ((uint32_t) status != size) {
+            break; // partial transfer
+        }
+    }
+    if (done > 0 || status >= 0) {
+        status = static_cast<FSError>(done);
+    }
+    return __fsa_end_positional(deviceData, file, write, status, offset);
+}
+
+ssize_t Mocha_FSPReadV(int fd, const MochaFSIOVec *iov, int iovcnt, off_t offset) {
+    return __fsa_transfer_vectored(fd, iov, iovcnt, offset, false);
+}
+
+ssize_t Mocha_FSPWriteV(int fd, const MochaFSIOVec *iov, int iovcnt, off_t offset) {
+    return __fsa_transfer_vectored(fd, iov, iovcnt, offset, true);
+}
+
+// Extends the file with zeros up to end if it's smaller, the file must be locked.
+static int __fsa_allocate_locked(__fsa_device_t *deviceData, __fsa_file_t *file, uint32_t end) {
+    FSError status = __fsa_flush_write_buffer(deviceData, file);
+    if (status >= 0) {
+        status = __fsa_update_file_stat(deviceData, file, true);
+    }
+    if (status >= 0) {
+        status = __fsa_acquire_file_handle(deviceData, file);
+    }
+    if (status < 0) {
+        return __fsa_translate_error(status);
+    }
+
+    const uint32_t size = file->stat.size;
+    if (end <= size) {
+        return 0;
+    }
+
+    const uint32_t chunkSize = MIN(end - size, deviceData->writeChunkSize);
+    std::unique_ptr<uint8_t, decltype(&free)> zeros((uint8_t *) memalign(0x40, ROUNDUP(chunkSize, 0x40)), free);
+    if (!zeros) {
+        return ENOMEM;
+    }
+    memset(zeros.get(), 0, chunkSize);
+
+    __fsa_drop_readahead(file);
+
+    uint32_t written = 0;
+    int result       = 0;
+    while (size + written < end) {
+        const uint32_t len = MIN(end - size - written, chunkSize);
+        status             = __fsa_transfer_at(deviceData, file, FSA_COMMAND_WRITE_FILE, zeros.get(), len, size + written);
+        if (status < 0) {
+            result = __fsa_translate_error(status);
+            break;
+        }
+        written += status;
+        if ((uint32_t) status != len) {
+            result = ENOSPC;
+            break;
+        }
+    }
+
+    if (written > 0) {
+        if (size + written > file->appendOffset) {
+            file->appendOffset = size + written;
+        }
+        __fsa_update_cached_size(file, size + written);
+        __fsa_invalidate_path(deviceData, file->fullPath, false);
+    }
+    return result;
+}
+
+int Mocha_FSPAllocate(int fd, off_t offset, off_t len) {
+    if (offset < 0 || len <= 0) {
+        return EINVAL;
+    }
+    if ((uint64_t) offset + (uint64_t) len > UINT32_MAX) {
+        return EFBIG;
+    }
+
+    // Reports errors through the return value only, like posix_fallocate
+    const int savedErrno = errno;
+    __fsa_device_t *deviceData;
+    __fsa_file_t *file = __fsa_get_file(fd, &deviceData);
+    if (!file) {
+        const int error = errno;
+        errno           = savedErrno;
+        return error;
+    }
+    if ((file->flags & O_ACCMODE) == O_RDONLY) {
+        return EBADF;
+    }
+
+    // Keeps positional writes from landing in the range while it's filled with zeros
+    __fsa_lock_unpinned_file(deviceData, file);
+    const int result = __fsa_allocate_locked(deviceData, file, (uint32_t) (offset + len));
+    file->mutex.unlock();
+    return result;
+}
@@ -1,9 +1,61 @@
 #include "../logger.h"
+#include "../utils.h"
 #include "devoptab_fsa.h"
 
+#include <memory>
 #include <mutex>
 #include <sys/param.h>
 
+// Serves small reads from the readahead buffer of the file and refills it with one large read when needed.
+// Returns false if the remaining bytes have to be read directly.
+static bool __fsa_read_buffered(struct _reent *r, __fsa_device_t *deviceData, __fsa_file_t *file, char *ptr, size_t len, ssize_t *bytesRead) {
+    if (!file->readBuffer) {
+        file->readBuffer = (uint8_t *) memalign(0x40, file->readBufferSize);
+        if (!file->readBuffer) {
+            DEBUG_FUNCTION_LINE_WARN("Failed to allocate readahead buffer for %s", file->fullPath);
+            file->readBufferSize = 0;
+            return false;
+        }
+    }
+
+    while ((size_t) *bytesRead < len) {
+        if (file->readBufferLength > 0) {
+            const uint32_t bufferEnd = file->readBufferOffset + file->readBufferLength;
+            if (file->offset < bufferEnd) {
+                const size_t size = MIN(len - *bytesRead, bufferEnd - file->offset);
+                memcpy(ptr, file->readBuffer + (file->offset - file->readBufferOffset), size);
+                file->offset += size;
+                *bytesRead += size;
+                ptr += size;
+                continue;
+            }
+            // Everything has been consumed
+            file->readBufferLength = 0;
+        }
+
+        if (len - *bytesRead >= file->readBufferSize) {
+            return false;
+        }
+
+        const FSError status = FSAReadFileWithPos(file->clientHandle, file->readBuffer, 1, file->readBufferSize, file->offset, file->fd, FSA_READ_FLAG_READ_WITH_POS);
+        if (status < 0) {
+            DEBUG_FUNCTION_LINE_ERR("FSAReadFileWithPos(0x%08X, %p, 1, 0x%08X, 0x%08X, 0x%08X) (%s) failed: %s",
+                                    file->clientHandle, file->readBuffer, file->readBufferSize, file->offset, file->fd, file->fullPath, FSAGetStatusStr(status));
+            if (*bytesRead == 0) {
+                r->_errno  = __fsa_translate_error(status);
+                *bytesRead = -1;
+            }
+            return true;
+        }
+        if (status == 0) {
+            return true; // end of file
+        }
+        file->readBufferOffset = file->offset;
+        file->readBufferLength = status;
+    }
+    return true;
+}
+
 ssize_t __fsa_read(struct _reent *r, void *fd, char *ptr, size_t len) {
     if (!fd || !ptr) {
         r->_errno = EINVAL;
@@ -24,14 +76,40 @@ ssize_t __fsa_read(struct _reent *r, void *fd, char *ptr, size_t len) {
 
     std::scoped_lock lock(file->mutex);
 
+    FSError status = __fsa_flush_write_buffer(deviceData, file);
+    if (status >= 0) {
+        status = __fsa_acquire_file_handle(deviceData, file);
+    }
+    if (status < 0) {
+        r->_errno = __fsa_translate_error(status);
+        return -1;
+    }
+
     size_t bytesRead = 0;
+    if (file->readBufferSize > 0) {
+        ssize_t bufferedBytes = 0;
+        if (__fsa_read_buffered(r, deviceData, file, ptr, len, &bufferedBytes)) {
+            return bufferedBytes;
+        }
+        bytesRead = bufferedBytes;
+        ptr += bufferedBytes;
+    }
+
+    // Read small misaligned requests with a single request instead of splitting off the partial cache-lines
+    std::unique_ptr<uint8_t, decltype(&free)> bounceBuffer(nullptr, free);
+    if (bytesRead < len && len - bytesRead <= deviceData->bounceBufferSize && (((uintptr_t) ptr & 0x3F) || ((len - bytesRead) & 0x3F))) {
+        bounceBuffer.reset((uint8_t *) memalign(0x40, ROUNDUP(len - bytesRead, 0x40)));
+    }
+
     while (bytesRead < len) {
         // only use input buffer if cache-aligned and read size is a multiple of cache line size
         // otherwise read into alignedBuffer
         uint8_t *tmp = (uint8_t *) ptr;
         size_t size  = len - bytesRead;
 
-        if (size < 0x40) {
+        if (bounceBuffer) {
+            tmp = bounceBuffer.get();
+        } else if (size < 0x40) {
             // read partial cache-line back-end
             tmp = alignedBuffer;
         } else if ((uintptr_t) ptr & 0x3F) {
@@ -43,17 +121,19 @@ ssize_t __fsa_read(struct _reent *r, void *fd, char *ptr, size_t len) {
             size &= ~0x3F;
         }
 
-        // Limit each request to 1 MiB
-        if (size > 0x100000) {
-            size = 0x100000;
+        FSError status;
+        if (size > deviceData->readChunkSize) {
+            // Split into chunks and keep multiple of them in flight
+            status = __fsa_transfer_pipelined(file->clientHandle, file, FSA_COMMAND_READ_FILE, tmp, size, file->offset, deviceData->readChunkSize, deviceData->pipelineDepth);
+        } else {
+            status = FSAReadFileWithPos(file->clientHandle, tmp, 1, size, file->offset, file->fd, FSA_READ_FLAG_READ_WITH_POS);
+            if (status < 0) {
+                DEBUG_FUNCTION_LINE_ERR("FSAReadFileWithPos(0x%08X, %p, 1, 0x%08X, 0x%08X, 0x%08X) (%s) failed: %s",
+                                        file->clientHandle, tmp, size, file->offset, file->fd, file->fullPath, FSAGetStatusStr(status));
+            }
         }
 
-        const FSError status = FSAReadFile(deviceData->clientHandle, tmp, 1, size, file->fd, 0);
-
         if (status < 0) {
-            DEBUG_FUNCTION_LINE_ERR("FSAReadFile(0x%08X, %p, 1, 0x%08X, 0x%08X, 0) (%s) failed: %s",
-                                    deviceData->clientHandle, tmp, size, file->fd, file->fullPath, FSAGetStatusStr(status));
-
             if (bytesRead != 0) {
                 return bytesRead; // error after partial read
             }
@@ -62,8 +142,8 @@ ssize_t __fsa_read(struct _reent *r, void *fd, char *ptr, size_t len) {
             return -1;
         }
 
-        if (tmp == alignedBuffer) {
-            memcpy(ptr, alignedBuffer, status);
+        if (tmp != (uint8_t *) ptr) {
+            memcpy(ptr, tmp, status);
         }
 
         file->offset += status;
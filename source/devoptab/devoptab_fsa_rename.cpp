@@ -10,32 +10,32 @@ int __fsa_rename(struct _reent *r,
         return -1;
     }
 
-    char *fixedOldPath = __fsa_fixpath(r, oldName);
-    if (!fixedOldPath) {
-        r->_errno = ENOMEM;
+    char fixedOldPath[FS_MAX_PATH + 1];
+    if (!__fsa_fixpath(r, oldName, fixedOldPath)) {
         return -1;
     }
 
-    char *fixedNewPath = __fsa_fixpath(r, newName);
-    if (!fixedNewPath) {
-        free(fixedOldPath);
-        r->_errno = ENOMEM;
+    char fixedNewPath[FS_MAX_PATH + 1];
+    if (!__fsa_fixpath(r, newName, fixedNewPath)) {
         return -1;
     }
 
     const auto deviceData = static_cast<__fsa_device_t *>(r->deviceData);
 
-    const FSError status = FSARename(deviceData->clientHandle, fixedOldPath, fixedNewPath);
+    // Files kept open by the handle cache can't be renamed or replaced
+    __fsa_handle_cache_evict(deviceData, fixedOldPath, true);
+    __fsa_handle_cache_evict(deviceData, fixedNewPath, true);
+
+    FSAClientLease client(deviceData);
+    const FSError status = FSARename(client.handle(), fixedOldPath, fixedNewPath);
+    __fsa_invalidate_path(deviceData, fixedOldPath, true);
+    __fsa_invalidate_path(deviceData, fixedNewPath, true);
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSARename(0x%08X, %s, %s) failed: %s",
-                                deviceData->clientHandle, fixedOldPath, fixedNewPath, FSAGetStatusStr(status));
-        free(fixedOldPath);
-        free(fixedNewPath);
+                                client.handle(), fixedOldPath, fixedNewPath, FSAGetStatusStr(status));
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
-    free(fixedOldPath);
-    free(fixedNewPath);
 
     return 0;
 }
@@ -9,24 +9,25 @@ int __fsa_rmdir(struct _reent *r,
         return -1;
     }
 
-    char *fixedPath = __fsa_fixpath(r, name);
-    if (!fixedPath) {
-        r->_errno = ENOMEM;
+    char fixedPath[FS_MAX_PATH + 1];
+    if (!__fsa_fixpath(r, name, fixedPath)) {
         return -1;
     }
 
-    const auto *deviceData = static_cast<__fsa_device_t *>(r->deviceData);
+    auto *deviceData = static_cast<__fsa_device_t *>(r->deviceData);
 
-    const FSError status = FSARemove(deviceData->clientHandle, fixedPath);
+    // Files kept open by the handle cache can't be removed
+    __fsa_handle_cache_evict(deviceData, fixedPath, true);
+
+    FSAClientLease client(deviceData);
+    const FSError status = FSARemove(client.handle(), fixedPath);
+    __fsa_invalidate_path(deviceData, fixedPath, true);
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSARemove(0x%08X, %s) failed: %s",
-                                deviceData->clientHandle, fixedPath, FSAGetStatusStr(status));
-        free(fixedPath);
+                                client.handle(), fixedPath, FSAGetStatusStr(status));
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
 
-    free(fixedPath);
-
     return 0;
 }
@@ -7,7 +7,6 @@ off_t __fsa_seek(struct _reent *r,
                  off_t pos,
                  int whence) {
     FSError status;
-    FSAStat fsStat;
     uint64_t offset;
 
     if (!fd) {
@@ -32,14 +31,18 @@ off_t __fsa_seek(struct _reent *r,
             break;
         }
         case SEEK_END: { // Set position relative to the end of the file
-            status = FSAGetStatFile(deviceData->clientHandle, file->fd, &fsStat);
-            if (status < 0) {
-                DEBUG_FUNCTION_LINE_ERR("FSAGetStatFile(0x%08X, 0x%08X, %p) (%s) failed: %s",
-                                        deviceData->clientHandle, file->fd, &fsStat, file->fullPath, FSAGetStatusStr(status));
-                r->_errno = __fsa_translate_error(status);
-                return -1;
+            if (!file->sizeValid) {
+                // The size has to include the pending writes
+                status = __fsa_flush_write_buffer(deviceData, file);
+                if (status >= 0) {
+                    status = __fsa_update_file_stat(deviceData, file, true);
+                }
+                if (status < 0) {
+                    r->_errno = __fsa_translate_error(status);
+                    return -1;
+                }
             }
-            offset = fsStat.size;
+            offset = file->stat.size;
             break;
         }
         default: { // An invalid option was provided
@@ -62,17 +65,20 @@ off_t __fsa_seek(struct _reent *r,
         return file->offset;
     }
 
-    uint32_t old_pos = file->offset;
-    file->offset     = offset + pos;
-
-    status = FSASetPosFile(deviceData->clientHandle, file->fd, file->offset);
+    status = __fsa_flush_write_buffer(deviceData, file);
     if (status < 0) {
-        DEBUG_FUNCTION_LINE_ERR("FSASetPosFile(0x%08X, 0x%08X, 0x%08X) (%s) failed: %s",
-                                deviceData->clientHandle, file->fd, file->offset, file->fullPath, FSAGetStatusStr(status));
-        file->offset = old_pos;
-        r->_errno    = __fsa_translate_error(status);
+        r->_errno = __fsa_translate_error(status);
         return -1;
     }
 
+    if (file->readBufferLength > 0) {
+        // Seeking within the readahead buffer keeps it
+        if ((uint32_t) (offset + pos) < file->readBufferOffset || (uint32_t) (offset + pos) > file->readBufferOffset + file->readBufferLength) {
+            file->readBufferLength = 0;
+        }
+    }
+
+    // Reads and writes pass the offset explicitly, the FSA handle doesn't need to be moved.
+    file->offset = offset + pos;
     return file->offset;
 }
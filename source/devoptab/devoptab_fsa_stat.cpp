@@ -12,26 +12,24 @@ int __fsa_stat(struct _reent *r,
         return -1;
     }
 
-    char *fixedPath = __fsa_fixpath(r, path);
-    if (!fixedPath) {
-        r->_errno = ENOMEM;
+    char fixedPath[FS_MAX_PATH + 1];
+    if (!__fsa_fixpath(r, path, fixedPath)) {
         return -1;
     }
 
     const auto deviceData = static_cast<__fsa_device_t *>(r->deviceData);
 
-    const FSError status = FSAGetStat(deviceData->clientHandle, fixedPath, &fsStat);
+    FSAClientLease client(deviceData);
+    const FSError status = __fsa_get_stat_cached(deviceData, client.handle(), fixedPath, &fsStat);
     if (status < 0) {
         if (status != FS_ERROR_NOT_FOUND) {
             DEBUG_FUNCTION_LINE_ERR("FSAGetStat(0x%08X, %s, %p) failed: %s",
-                                    deviceData->clientHandle, fixedPath, &fsStat, FSAGetStatusStr(status));
+                                    client.handle(), fixedPath, &fsStat, FSAGetStatusStr(status));
         }
-        free(fixedPath);
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
     const ino_t ino = __fsa_hashstring(fixedPath);
-    free(fixedPath);
 
     __fsa_translate_stat(deviceData->clientHandle, &fsStat, ino, st);
 
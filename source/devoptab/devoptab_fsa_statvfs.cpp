@@ -6,7 +6,7 @@ int __fsa_statvfs(struct _reent *r,
                   struct statvfs *buf) {
     uint64_t freeSpace;
 
-    const auto *deviceData = static_cast<__fsa_device_t *>(r->deviceData);
+    auto *deviceData = static_cast<__fsa_device_t *>(r->deviceData);
     if (deviceData->isSDCard) {
         r->_errno = ENOSYS;
         return -1;
@@ -14,21 +14,19 @@ int __fsa_statvfs(struct _reent *r,
 
     memset(buf, 0, sizeof(struct statvfs));
 
-    char *fixedPath = __fsa_fixpath(r, path);
-    if (!fixedPath) {
-        r->_errno = ENOMEM;
+    char fixedPath[FS_MAX_PATH + 1];
+    if (!__fsa_fixpath(r, path, fixedPath)) {
         return -1;
     }
 
-    const FSError status = FSAGetFreeSpaceSize(deviceData->clientHandle, fixedPath, &freeSpace);
+    FSAClientLease client(deviceData);
+    const FSError status = FSAGetFreeSpaceSize(client.handle(), fixedPath, &freeSpace);
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSAGetFreeSpaceSize(0x%08X, %s, %p) failed: %s",
-                                deviceData->clientHandle, fixedPath, &freeSpace, FSAGetStatusStr(status));
-        free(fixedPath);
+                                client.handle(), fixedPath, &freeSpace, FSAGetStatusStr(status));
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
-    free(fixedPath);
 
     // File system block size
     buf->f_bsize = deviceData->deviceSectorSize;
@@ -12,27 +12,46 @@ int __fsa_ftruncate(struct _reent *r,
         return -1;
     }
 
-    auto *file             = static_cast<__fsa_file_t *>(fd);
-    const auto *deviceData = static_cast<__fsa_device_t *>(r->deviceData);
+    auto *file       = static_cast<__fsa_file_t *>(fd);
+    auto *deviceData = static_cast<__fsa_device_t *>(r->deviceData);
 
-    std::scoped_lock lock(file->mutex);
+    // FSATruncateFile cuts at the position of the FSA handle, which is moved by positional requests too
+    __fsa_lock_unpinned_file(deviceData, file);
+    std::scoped_lock lock(std::adopt_lock, file->mutex);
+
+    // The buffered data might be beyond the new end of the file.
+    FSError status = __fsa_flush_write_buffer(deviceData, file);
+    __fsa_drop_readahead(file);
+    if (status >= 0) {
+        status = __fsa_acquire_file_handle(deviceData, file);
+    }
+    if (status < 0) {
+        r->_errno = __fsa_translate_error(status);
+        return -1;
+    }
 
     // Set the new file size
-    FSError status = FSASetPosFile(deviceData->clientHandle, file->fd, len);
+    status = FSASetPosFile(file->clientHandle, file->fd, len);
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSASetPosFile(0x%08X, 0x%08X, 0x%08llX) failed: %s",
-                                deviceData->clientHandle, file->fd, len, FSAGetStatusStr(status));
+                                file->clientHandle, file->fd, len, FSAGetStatusStr(status));
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
 
-    status = FSATruncateFile(deviceData->clientHandle, file->fd);
+    status = FSATruncateFile(file->clientHandle, file->fd);
+    __fsa_invalidate_path(deviceData, file->fullPath, false);
     if (status < 0) {
         DEBUG_FUNCTION_LINE_ERR("FSATruncateFile(0x%08X, 0x%08X) failed: %s",
-                                deviceData->clientHandle, file->fd, FSAGetStatusStr(status));
+                                file->clientHandle, file->fd, FSAGetStatusStr(status));
         r->_errno = __fsa_translate_error(status);
         return -1;
     }
 
+    file->appendOffset = len;
+    file->stat.size    = len;
+    file->statValid    = false;
+    file->sizeValid    = file->cacheStat;
+
     return 0;
 }
@@ -9,143 +9,232 @@
 #define iseos(ch)     ((ch) == '\0')
 #define ispathend(ch) (ispathsep(ch) || iseos(ch))
 
-// https://gist.github.com/starwing/2761647
-static char *
-__fsa_normpath(char *out, const char *in) {
-    char *pos[COMP_MAX], **top = pos, *head = out;
-    int isabs = ispathsep(*in);
-
-    if (isabs) *out++ = '/';
-    *top++ = out;
-
-    while (!iseos(*in)) {
-        while (ispathsep(*in)) {
-            ++in;
+namespace {
+// The input of __fsa_normpath, up to three strings that are read as if they were concatenated.
+// The input is limited to PATH_MAX - 1 characters, reading past its end returns '\0'.
+class PathInput {
+public:
+    PathInput(const char *a, const char *b, const char *c) : mParts{a, b, c}, mLengths{strlen(a), strlen(b), strlen(c)} {
+        mTotal = MIN(mLengths[0] + mLengths[1] + mLengths[2], (size_t) PATH_MAX - 1);
+    }
+
+    [[nodiscard]] size_t length() const {
+        return mTotal;
+    }
+
+    char operator[](size_t i) const {
+        if (i >= mTotal) {
+            return '\0';
         }
+        for (size_t part = 0;; part++) {
+            if (i < mLengths[part]) {
+                return mParts[part][i];
+            }
+            i -= mLengths[part];
+        }
+    }
 
-        if (iseos(*in)) {
+private:
+    const char *mParts[3];
+    size_t mLengths[3];
+    size_t mTotal;
+};
+} // namespace
+
+// Based on https://gist.github.com/starwing/2761647, but writes into a buffer of outSize bytes in a single pass.
+// Returns the length of the normalized path, which may be >= outSize if it didn't fit, or -1 if the path has too many components.
+static ssize_t
+__fsa_normpath(char *out, size_t outSize, const PathInput &in) {
+    size_t pos[COMP_MAX], top = 0, o = 0, i = 0;
+    const bool isabs = ispathsep(in[0]);
+
+    // Components that don't fit are still counted, a following ".." may remove them again
+    auto put = [&](char ch) {
+        if (o < outSize) {
+            out[o] = ch;
+        }
+        o++;
+    };
+
+    if (isabs) put('/');
+    pos[top++] = o;
+
+    while (!iseos(in[i])) {
+        while (ispathsep(in[i])) {
+            ++i;
+        }
+
+        if (iseos(in[i])) {
             break;
         }
 
-        if (memcmp(in, ".", 1) == 0 && ispathend(in[1])) {
-            ++in;
+        if (in[i] == '.' && ispathend(in[i + 1])) {
+            ++i;
             continue;
         }
 
-        if (memcmp(in, "..", 2) == 0 && ispathend(in[2])) {
-            in += 2;
-            if (top != pos + 1) {
-                out = *--top;
+        if (in[i] == '.' && in[i + 1] == '.' && ispathend(in[i + 2])) {
+            i += 2;
+            if (top != 1) {
+                o = pos[--top];
             } else if (isabs) {
-                out = top[-1];
+                o = pos[0];
             } else {
-                strcpy(out, "../");
-                out += 3;
+                put('.');
+                put('.');
+                put('/');
             }
             continue;
         }
 
-        if (top - pos >= COMP_MAX) {
-            return NULL; // path to complicate
+        if (top >= COMP_MAX) {
+            return -1; // path to complicate
         }
 
-        *top++ = out;
-        while (!ispathend(*in)) {
-            *out++ = *in++;
+        pos[top++] = o;
+        while (!ispathend(in[i])) {
+            put(in[i++]);
         }
-        if (ispathsep(*in)) {
-            *out++ = '/';
+        if (ispathsep(in[i])) {
+            put('/');
         }
     }
 
-    *out = '\0';
-    if (*head == '\0') {
-        strcpy(head, "./");
+    if (o == 0) {
+        put('.');
+        put('/');
+    }
+    if (o < outSize) {
+        out[o] = '\0';
     }
-    return head;
+    return (ssize_t) o;
 }
 
 uint32_t
 __fsa_hashstring(const char *str) {
-    uint32_t h;
-    uint8_t *p;
+    return __fsa_hashstring_append(0, str);
+}
 
-    h = 0;
-    for (p = (uint8_t *) str; *p != '\0'; p++) {
+// Continues a hash, __fsa_hashstring_append(__fsa_hashstring(a), b) equals the hash of a followed by b.
+uint32_t
+__fsa_hashstring_append(uint32_t h, const char *str) {
+    for (auto *p = (const uint8_t *) str; *p != '\0'; p++) {
         h = 37 * h + *p;
     }
     return h;
 }
 
+void
+__fsa_drop_readahead(__fsa_file_t *file) {
+    file->readBufferLength = 0;
+}
+
+FSError
+__fsa_flush_write_buffer(__fsa_device_t *deviceData, __fsa_file_t *file) {
+    if (file->writeBufferLength == 0) {
+        return FS_ERROR_OK;
+    }
+    FSError status = __fsa_acquire_file_handle(deviceData, file);
+    if (status < 0) {
+        return status;
+    }
+
+    uint32_t written = 0;
+    while (written < file->writeBufferLength) {
+        const uint32_t size = MIN(file->writeBufferLength - written, deviceData->writeChunkSize);
+        const uint32_t pos  = file->offset - file->writeBufferLength + written;
+        if (file->flags & O_APPEND) {
+            status = FSAWriteFile(file->clientHandle, file->writeBuffer + written, 1, size, file->fd, 0);
+        } else {
+            status = FSAWriteFileWithPos(file->clientHandle, file->writeBuffer + written, 1, size, pos, file->fd, FSA_WRITE_FLAG_READ_WITH_POS);
+        }
+        if (status < 0) {
+            DEBUG_FUNCTION_LINE_ERR("FSAWriteFileWithPos(0x%08X, %p, 1, 0x%08X, 0x%08X, 0x%08X) (%s) failed: %s",
+                                    file->clientHandle, file->writeBuffer + written, size, pos, file->fd, file->fullPath, FSAGetStatusStr(status));
+            break;
+        }
+        written += status;
+        if ((uint32_t) status != size) {
+            status = FS_ERROR_STORAGE_FULL;
+            break;
+        }
+    }
+
+    // Keep whatever couldn't be written, it still ends at file->offset.
+    if (written > 0 && written < file->writeBufferLength) {
+        memmove(file->writeBuffer, file->writeBuffer + written, file->writeBufferLength - written);
+    }
+    file->writeBufferLength -= written;
+    if (written > 0) {
+        __fsa_invalidate_path(deviceData, file->fullPath, false);
+    }
+    return status < 0 ? status : FS_ERROR_OK;
+}
+
+FSError
+__fsa_update_file_stat(__fsa_device_t *deviceData, __fsa_file_t *file, bool sizeOnly) {
+    if (file->statValid || (sizeOnly && file->sizeValid)) {
+        return FS_ERROR_OK;
+    }
+    FSError status = __fsa_acquire_file_handle(deviceData, file);
+    if (status < 0) {
+        return status;
+    }
+    status = FSAGetStatFile(file->clientHandle, file->fd, &file->stat);
+    if (status < 0) {
+        DEBUG_FUNCTION_LINE_ERR("FSAGetStatFile(0x%08X, 0x%08X, %p) (%s) failed: %s",
+                                file->clientHandle, file->fd, &file->stat, file->fullPath, FSAGetStatusStr(status));
+        file->statValid = false;
+        file->sizeValid = false;
+        return status;
+    }
+    file->statValid = file->cacheStat;
+    file->sizeValid = file->cacheStat;
+    return FS_ERROR_OK;
+}
+
+// Drops everything the mount has cached about path, after it has been changed through the mount
+void
+__fsa_invalidate_path(__fsa_device_t *deviceData, const char *path, bool withChildren) {
+    __fsa_metadata_cache_invalidate(deviceData, path, withChildren);
+    __fsa_handle_cache_evict(deviceData, path, withChildren);
+}
+
 char *
 __fsa_fixpath(struct _reent *r,
-              const char *path) {
-    char *p;
+              const char *path,
+              char *fixedPath) {
+    const char *p;
 
     if (!path) {
         r->_errno = EINVAL;
         return NULL;
     }
 
-    p = strchr(path, ':') + 1;
-    if (!strchr(path, ':')) {
-        p = (char *) path;
-    }
+    p = strchr(path, ':');
+    p = p ? p + 1 : path;
 
     // wii u softlocks on empty strings so give expected error back
-    if (strlen(p) == 0) {
+    if (p[0] == '\0') {
         r->_errno = ENOENT;
         return NULL;
     }
 
-    int maxPathLength = PATH_MAX;
-    auto fixedPath    = static_cast<char *>(memalign(0x40, maxPathLength));
-    if (!fixedPath) {
-        DEBUG_FUNCTION_LINE_ERR("__fsa_fixpath: failed to allocate memory for fixedPath");
-        r->_errno = ENOMEM;
-        return NULL;
-    }
-
-    // Convert to an absolute path
-    if (p[0] != '\0' && p[0] != '\\' && p[0] != '/') {
-        __fsa_device_t *deviceData = (__fsa_device_t *) r->deviceData;
-        if (snprintf(fixedPath, maxPathLength, "%s/%s", deviceData->cwd, p) >= maxPathLength) {
-            DEBUG_FUNCTION_LINE_ERR("__fsa_fixpath: fixedPath snprintf result (relative) was truncated");
-        }
-    } else {
-        const auto deviceData = static_cast<__fsa_device_t *>(r->deviceData);
-        if (snprintf(fixedPath, maxPathLength, "%s%s", deviceData->mountPath, p) >= maxPathLength) {
-            DEBUG_FUNCTION_LINE_ERR("__fsa_fixpath: fixedPath snprintf result (absolute) was truncated");
-        }
-    }
-
-    // Normalize path (resolve any ".", "..", or "//")
-    char *normalizedPath = strdup(fixedPath);
-    if (!normalizedPath) {
-        DEBUG_FUNCTION_LINE_ERR("__fsa_fixpath: failed to allocate memory for normalizedPath");
-        free(fixedPath);
-        r->_errno = ENOMEM;
-        return NULL;
+    // Convert to an absolute path and normalize it (resolve any ".", "..", or "//") in one go
+    const auto deviceData = static_cast<__fsa_device_t *>(r->deviceData);
+    const bool relative   = p[0] != '\\' && p[0] != '/';
+    const PathInput input(relative ? deviceData->cwd : deviceData->mountPath, relative ? "/" : "", p);
+    if (input.length() == PATH_MAX - 1) {
+        DEBUG_FUNCTION_LINE_ERR("__fsa_fixpath: path was truncated");
     }
 
-    char *resPath = __fsa_normpath(normalizedPath, fixedPath);
-    if (!resPath) {
+    const ssize_t length = __fsa_normpath(fixedPath, FS_MAX_PATH + 1, input);
+    if (length < 0) {
         DEBUG_FUNCTION_LINE_ERR("__fsa_fixpath: failed to normalize path");
-        free(normalizedPath);
-        free(fixedPath);
         r->_errno = EIO;
         return NULL;
     }
-
-    if (snprintf(fixedPath, maxPathLength, "%s", resPath) >= maxPathLength) {
-        DEBUG_FUNCTION_LINE_ERR("__fsa_fixpath: fixedPath snprintf result (relative) was truncated");
-    }
-
-    free(normalizedPath);
-
-    size_t pathLength = strlen(fixedPath);
-    if (pathLength > FS_MAX_PATH) {
-        free(fixedPath);
+    if (length > FS_MAX_PATH) {
         r->_errno = ENAMETOOLONG;
         return NULL;
     }
@@ -1,7 +1,44 @@
 #include "../logger.h"
+#include "../utils.h"
 #include "devoptab_fsa.h"
+#include <memory>
 #include <mutex>
 
+// Collects small writes in the write-behind buffer of the file, the buffer is written once it's full.
+// Returns false if the data has to be written directly.
+static bool __fsa_write_buffered(struct _reent *r, __fsa_device_t *deviceData, __fsa_file_t *file, const char *ptr, size_t len, ssize_t *bytesWritten) {
+    if (!file->writeBuffer) {
+        file->writeBuffer = (uint8_t *) memalign(0x40, file->writeBufferSize);
+        if (!file->writeBuffer) {
+            DEBUG_FUNCTION_LINE_WARN("Failed to allocate write buffer for %s", file->fullPath);
+            file->writeBufferSize = 0;
+            return false;
+        }
+    }
+
+    if (file->writeBufferLength + len > file->writeBufferSize) {
+        const FSError status = __fsa_flush_write_buffer(deviceData, file);
+        if (status < 0) {
+            r->_errno     = __fsa_translate_error(status);
+            *bytesWritten = -1;
+            return true;
+        }
+    }
+
+    memcpy(file->writeBuffer + file->writeBufferLength, ptr, len);
+    file->writeBufferLength += len;
+    file->appendOffset += len;
+    file->offset += len;
+    __fsa_update_cached_size(file, file->offset);
+    *bytesWritten = len;
+
+    if (file->writeBufferLength == file->writeBufferSize) {
+        // The data has been accepted already, a failed write will be reported by the next operation.
+        __fsa_flush_write_buffer(deviceData, file);
+    }
+    return true;
+}
+
 ssize_t __fsa_write(struct _reent *r, void *fd, const char *ptr, size_t len) {
     if (!fd || !ptr) {
         r->_errno = EINVAL;
@@ -22,12 +59,37 @@ ssize_t __fsa_write(struct _reent *r, void *fd, const char *ptr, size_t len) {
 
     std::scoped_lock lock(file->mutex);
 
+    __fsa_drop_readahead(file);
+
     // If O_APPEND is set, we always write to the end of the file.
     // When writing we file->offset to the file size to keep in sync.
     if (file->flags & O_APPEND) {
         file->offset = file->appendOffset;
     }
 
+    if (file->writeBufferSize > 0 && !(file->flags & O_SYNC) && len < file->writeBufferSize) {
+        ssize_t bufferedBytes = 0;
+        if (__fsa_write_buffered(r, deviceData, file, ptr, len, &bufferedBytes)) {
+            return bufferedBytes;
+        }
+    }
+
+    // Keep the order of the writes
+    FSError status = __fsa_flush_write_buffer(deviceData, file);
+    if (status >= 0) {
+        status = __fsa_acquire_file_handle(deviceData, file);
+    }
+    if (status < 0) {
+        r->_errno = __fsa_translate_error(status);
+        return -1;
+    }
+
+    // Write small misaligned requests with a single request instead of splitting off the partial cache-lines
+    std::unique_ptr<uint8_t, decltype(&free)> bounceBuffer(nullptr, free);
+    if (len > 0 && len <= deviceData->bounceBufferSize && (((uintptr_t) ptr & 0x3F) || (len & 0x3F))) {
+        bounceBuffer.reset((uint8_t *) memalign(0x40, ROUNDUP(len, 0x40)));
+    }
+
     size_t bytesWritten = 0;
     while (bytesWritten < len) {
         // only use input buffer if cache-aligned and write size is a multiple of cache line size
@@ -35,7 +97,9 @@ ssize_t __fsa_write(struct _reent *r, void *fd, const char *ptr, size_t len) {
         uint8_t *tmp = (uint8_t *) ptr;
         size_t size  = len - bytesWritten;
 
-        if (size < 0x40) {
+        if (bounceBuffer) {
+            tmp = bounceBuffer.get();
+        } else if (size < 0x40) {
             // write partial cache-line back-end
             tmp = alignedBuffer;
         } else if ((uintptr_t) ptr & 0x3F) {
@@ -47,19 +111,33 @@ ssize_t __fsa_write(struct _reent *r, void *fd, const char *ptr, size_t len) {
             size &= ~0x3F;
         }
 
-        // Limit each request to 256 KiB
-        if (size > 0x40000) {
-            size = 0x40000;
+        // Both paths below write from tmp, the pipelined one included
+        if (tmp != (uint8_t *) ptr) {
+            memcpy(tmp, ptr, size);
         }
 
-        if (tmp == alignedBuffer) {
-            memcpy(tmp, ptr, size);
+        if (size > deviceData->writeChunkSize && !(file->flags & O_APPEND)) {
+            // Split into chunks and keep multiple of them in flight.
+            // Appending ignores the position of the requests, so it has to stay strictly ordered.
+            status = __fsa_transfer_pipelined(file->clientHandle, file, FSA_COMMAND_WRITE_FILE, tmp, size, file->offset, deviceData->writeChunkSize, deviceData->pipelineDepth);
+        } else {
+            // Limit each request to the chunk size of the mount
+            if (size > deviceData->writeChunkSize) {
+                size = deviceData->writeChunkSize;
+            }
+
+            if (file->flags & O_APPEND) {
+                status = FSAWriteFile(file->clientHandle, tmp, 1, size, file->fd, 0);
+            } else {
+                status = FSAWriteFileWithPos(file->clientHandle, tmp, 1, size, file->offset, file->fd, FSA_WRITE_FLAG_READ_WITH_POS);
+            }
+            if (status < 0) {
+                DEBUG_FUNCTION_LINE_ERR("FSAWriteFileWithPos(0x%08X, %p, 1, 0x%08X, 0x%08X, 0x%08X) (%s) failed: %s",
+                                        file->clientHandle, tmp, size, file->offset, file->fd, file->fullPath, FSAGetStatusStr(status));
+            }
         }
 
-        const FSError status = FSAWriteFile(deviceData->clientHandle, tmp, 1, size, file->fd, 0);
         if (status < 0) {
-            DEBUG_FUNCTION_LINE_ERR("FSAWriteFile(0x%08X, %p, 1, 0x%08X, 0x%08X, 0) (%s) failed: %s",
-                                    deviceData->clientHandle, tmp, size, file->fd, file->fullPath, FSAGetStatusStr(status));
             if (bytesWritten != 0) {
                 return bytesWritten; // error after partial write
             }
@@ -70,6 +148,8 @@ ssize_t __fsa_write(struct _reent *r, void *fd, const char *ptr, size_t len) {
 
         file->appendOffset += status;
         file->offset += status;
+        __fsa_update_cached_size(file, file->offset);
+        __fsa_invalidate_path(deviceData, file->fullPath, false);
         bytesWritten += status;
         ptr += status;
 
@@ -0,0 +1,379 @@
+#include "disc_cache.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstring>
+#include <malloc.h>
+#include <new>
+
+// Requests of at least this many blocks are passed to the lower layer directly
+#define DISC_CACHE_BYPASS_BLOCKS 4
+
+DiscSectorCache::~DiscSectorCache() {
+    release();
+}
+
+void DiscSectorCache::release() {
+    free(mData);
+    delete[] mEntries;
+    delete[] mBuckets;
+    delete[] mFlushOrder;
+    mData            = nullptr;
+    mEntries         = nullptr;
+    mBuckets         = nullptr;
+    mFlushOrder      = nullptr;
+    mNumBuckets      = 0;
+    mNumBlocks       = 0;
+    mSectorsPerBlock = 0;
+    mLruHead         = -1;
+    mLruTail         = -1;
+}
+
+bool DiscSectorCache::isValidSize(uint32_t numBlocks, uint32_t sectorsPerBlock, uint32_t sectorSize) {
+    if (numBlocks == 0 || sectorsPerBlock == 0 || sectorSize == 0) {
+        return true;
+    }
+    return numBlocks <= DISC_CACHE_MAX_BLOCKS && DiscBufferSizeValid((uint64_t) numBlocks * sectorsPerBlock, sectorSize);
+}
+
+bool DiscSectorCache::configure(uint32_t numBlocks, uint32_t sectorsPerBlock, uint32_t sectorSize, bool writeBack) {
+    if (!isValidSize(numBlocks, sectorsPerBlock, sectorSize)) {
+        DEBUG_FUNCTION_LINE_ERR("Sector cache of %d blocks of %d sectors of %d bytes is too large", numBlocks, sectorsPerBlock, sectorSize);
+        return false;
+    }
+    if (!flush()) {
+        return false;
+    }
+    release();
+
+    mWriteBack = writeBack;
+    if (numBlocks == 0 || sectorsPerBlock == 0 || sectorSize == 0) {
+        return true;
+    }
+
+    uint32_t numBuckets = 1;
+    while (numBuckets < numBlocks * 2) {
+        numBuckets <<= 1;
+    }
+
+    mData    = (uint8_t *) memalign(0x40, numBlocks * sectorsPerBlock * sectorSize);
+    mEntries = new (std::nothrow) Entry[numBlocks];
+    mBuckets = new (std::nothrow) int32_t[numBuckets];
+    // Scratch space of flush, so writing back the dirty blocks doesn't allocate
+    mFlushOrder = new (std::nothrow) int32_t[numBlocks];
+    if (!mData || !mEntries || !mBuckets || !mFlushOrder) {
+        DEBUG_FUNCTION_LINE_ERR("Failed to allocate sector cache (%d blocks of %d sectors)", numBlocks, sectorsPerBlock);
+        release();
+        return false;
+    }
+
+    mNumBlocks       = numBlocks;
+    mNumBuckets      = numBuckets;
+    mSectorsPerBlock = sectorsPerBlock;
+    mSectorSize      = sectorSize;
+    invalidate();
+    return true;
+}
+
+bool DiscSectorCache::setSectorSize(uint32_t sectorSize) {
+    if (!isEnabled() || sectorSize == mSectorSize) {
+        mSectorSize = sectorSize;
+        return true;
+    }
+    return configure(mNumBlocks, mSectorsPerBlock, sectorSize, mWriteBack);
+}
+
+void DiscSectorCache::invalidate() {
+    if (!isEnabled()) {
+        return;
+    }
+    for (uint32_t i = 0; i < mNumBuckets; i++) {
+        mBuckets[i] = -1;
+    }
+    for (uint32_t i = 0; i < mNumBlocks; i++) {
+        auto &entry    = mEntries[i];
+        entry.block    = 0;
+        entry.hashNext = -1;
+        entry.lruPrev  = (int32_t) i - 1;
+        entry.lruNext  = (i + 1 < mNumBlocks) ? (int32_t) i + 1 : -1;
+        entry.valid    = false;
+        entry.dirty    = false;
+    }
+    mLruHead = 0;
+    mLruTail = (int32_t) mNumBlocks - 1;
+}
+
+int32_t DiscSectorCache::lookup(uint32_t block) const {
+    for (int32_t idx = mBuckets[hashBucket(block)]; idx >= 0; idx = mEntries[idx].hashNext) {
+        if (mEntries[idx].block == block) {
+            return idx;
+        }
+    }
+    return -1;
+}
+
+void DiscSectorCache::hashInsert(int32_t idx) {
+    auto &bucket           = mBuckets[hashBucket(mEntries[idx].block)];
+    mEntries[idx].hashNext = bucket;
+    bucket                 = idx;
+}
+
+void DiscSectorCache::hashRemove(int32_t idx) {
+    int32_t *cur = &mBuckets[hashBucket(mEntries[idx].block)];
+    while (*cur >= 0) {
+        if (*cur == idx) {
+            *cur = mEntries[idx].hashNext;
+            break;
+        }
+        cur = &mEntries[*cur].hashNext;
+    }
+    mEntries[idx].hashNext = -1;
+}
+
+void DiscSectorCache::lruUnlink(int32_t idx) {
+    auto &entry = mEntries[idx];
+    if (entry.lruPrev >= 0) {
+        mEntries[entry.lruPrev].lruNext = entry.lruNext;
+    } else {
+        mLruHead = entry.lruNext;
+    }
+    if (entry.lruNext >= 0) {
+        mEntries[entry.lruNext].lruPrev = entry.lruPrev;
+    } else {
+        mLruTail = entry.lruPrev;
+    }
+    entry.lruPrev = -1;
+    entry.lruNext = -1;
+}
+
+void DiscSectorCache::lruPushFront(int32_t idx) {
+    auto &entry   = mEntries[idx];
+    entry.lruPrev = -1;
+    entry.lruNext = mLruHead;
+    if (mLruHead >= 0) {
+        mEntries[mLruHead].lruPrev = idx;
+    }
+    mLruHead = idx;
+    if (mLruTail < 0) {
+        mLruTail = idx;
+    }
+}
+
+void DiscSectorCache::lruPushBack(int32_t idx) {
+    auto &entry   = mEntries[idx];
+    entry.lruNext = -1;
+    entry.lruPrev = mLruTail;
+    if (mLruTail >= 0) {
+        mEntries[mLruTail].lruNext = idx;
+    }
+    mLruTail = idx;
+    if (mLruHead < 0) {
+        mLruHead = idx;
+    }
+}
+
+bool DiscSectorCache::writeBackEntry(int32_t idx) {
+    auto &entry = mEntries[idx];
+    if (!entry.valid || !entry.dirty) {
+        return true;
+    }
+    if (!mLower->writeSectors(entry.block * mSectorsPerBlock, mSectorsPerBlock, blockData(idx))) {
+        return false;
+    }
+    entry.dirty = false;
+    writeBacks++;
+    return true;
+}
+
+int32_t DiscSectorCache::acquireSlot(uint32_t block) {
+    // Reuse the least recently used block
+    int32_t idx = mLruTail;
+    auto &entry = mEntries[idx];
+    if (entry.valid) {
+        if (!writeBackEntry(idx)) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to write back block %d", entry.block);
+            return -1;
+        }
+        hashRemove(idx);
+    }
+    entry.block = block;
+    entry.valid = true;
+    entry.dirty = false;
+    hashInsert(idx);
+    lruUnlink(idx);
+    lruPushFront(idx);
+    return idx;
+}
+
+void DiscSectorCache::dropSlot(int32_t idx) {
+    hashRemove(idx);
+    mEntries[idx].valid = false;
+    mEntries[idx].dirty = false;
+    lruUnlink(idx);
+    lruPushBack(idx);
+}
+
+int32_t DiscSectorCache::loadBlock(uint32_t block) {
+    int32_t idx = acquireSlot(block);
+    if (idx < 0) {
+        return -1;
+    }
+    if (!mLower->readSectors(block * mSectorsPerBlock, mSectorsPerBlock, blockData(idx))) {
+        // e.g. the block exceeds the end of the device
+        dropSlot(idx);
+        return -1;
+    }
+    return idx;
+}
+
+bool DiscSectorCache::flushRange(uint32_t sector, uint32_t numSectors) {
+    const uint64_t end = (uint64_t) sector + numSectors;
+    for (uint32_t i = 0; i < mNumBlocks; i++) {
+        const auto &entry = mEntries[i];
+        if (!entry.valid || !entry.dirty) {
+            continue;
+        }
+        const uint64_t blockStart = (uint64_t) entry.block * mSectorsPerBlock;
+        if (blockStart < end && blockStart + mSectorsPerBlock > sector) {
+            if (!writeBackEntry((int32_t) i)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void DiscSectorCache::updateCached(uint32_t sector, uint32_t numSectors, const uint8_t *buffer) {
+    const uint64_t end = (uint64_t) sector + numSectors;
+    for (uint32_t i = 0; i < mNumBlocks; i++) {
+        const auto &entry = mEntries[i];
+        if (!entry.valid) {
+            continue;
+        }
+        const uint64_t blockStart = (uint64_t) entry.block * mSectorsPerBlock;
+        const uint64_t blockEnd   = blockStart + mSectorsPerBlock;
+        if (blockStart >= end || blockEnd <= sector) {
+            continue;
+        }
+        const uint64_t copyStart = std::max<uint64_t>(blockStart, sector);
+        const uint64_t copyEnd   = std::min<uint64_t>(blockEnd, end);
+        memcpy(blockData((int32_t) i) + (copyStart - blockStart) * mSectorSize,
+               buffer + (copyStart - sector) * mSectorSize,
+               (copyEnd - copyStart) * mSectorSize);
+    }
+}
+
+bool DiscSectorCache::readSectors(uint32_t sector, uint32_t numSectors, void *buffer) {
+    if (!isEnabled()) {
+        return mLower->readSectors(sector, numSectors, buffer);
+    }
+
+    if (numSectors >= DISC_CACHE_BYPASS_BLOCKS * mSectorsPerBlock) {
+        bypasses++;
+        // Make sure the device has the latest data before reading from it.
+        if (!flushRange(sector, numSectors)) {
+            return false;
+        }
+        return mLower->readSectors(sector, numSectors, buffer);
+    }
+
+    auto *out = (uint8_t *) buffer;
+    while (numSectors > 0) {
+        const uint32_t block  = sector / mSectorsPerBlock;
+        const uint32_t offset = sector % mSectorsPerBlock;
+        const uint32_t count  = std::min(numSectors, mSectorsPerBlock - offset);
+
+        int32_t idx = lookup(block);
+        if (idx >= 0) {
+            hits++;
+            lruUnlink(idx);
+            lruPushFront(idx);
+        } else {
+            misses++;
+            idx = loadBlock(block);
+        }
+
+        if (idx >= 0) {
+            memcpy(out, blockData(idx) + offset * mSectorSize, count * mSectorSize);
+        } else if (!mLower->readSectors(sector, count, out)) {
+            return false;
+        }
+
+        out += count * mSectorSize;
+        sector += count;
+        numSectors -= count;
+    }
+    return true;
+}
+
+bool DiscSectorCache::writeSectors(uint32_t sector, uint32_t numSectors, const void *buffer) {
+    if (!isEnabled()) {
+        return mLower->writeSectors(sector, numSectors, buffer);
+    }
+
+    if (!mWriteBack || numSectors >= DISC_CACHE_BYPASS_BLOCKS * mSectorsPerBlock) {
+        if (mWriteBack) {
+            bypasses++;
+        }
+        if (!mLower->writeSectors(sector, numSectors, buffer)) {
+            return false;
+        }
+        // Keep the cached copies up to date. Dirty blocks stay dirty, writing them back later is harmless.
+        updateCached(sector, numSectors, (const uint8_t *) buffer);
+        return true;
+    }
+
+    auto *in = (const uint8_t *) buffer;
+    while (numSectors > 0) {
+        const uint32_t block  = sector / mSectorsPerBlock;
+        const uint32_t offset = sector % mSectorsPerBlock;
+        const uint32_t count  = std::min(numSectors, mSectorsPerBlock - offset);
+
+        int32_t idx = lookup(block);
+        if (idx >= 0) {
+            hits++;
+            lruUnlink(idx);
+            lruPushFront(idx);
+        } else {
+            misses++;
+            // No need to read the block if it's going to be overwritten completely.
+            idx = (count == mSectorsPerBlock) ? acquireSlot(block) : loadBlock(block);
+        }
+
+        if (idx >= 0) {
+            memcpy(blockData(idx) + offset * mSectorSize, in, count * mSectorSize);
+            mEntries[idx].dirty = true;
+        } else if (!mLower->writeSectors(sector, count, in)) {
+            return false;
+        }
+
+        in += count * mSectorSize;
+        sector += count;
+        numSectors -= count;
+    }
+    return true;
+}
+
+bool DiscSectorCache::flush() {
+    if (!isEnabled()) {
+        return mLower->flush();
+    }
+
+    // Write back in ascending order to keep the writes sequential
+    uint32_t numDirty = 0;
+    for (uint32_t i = 0; i < mNumBlocks; i++) {
+        if (mEntries[i].valid && mEntries[i].dirty) {
+            mFlushOrder[numDirty++] = (int32_t) i;
+        }
+    }
+    std::sort(mFlushOrder, mFlushOrder + numDirty, [this](int32_t a, int32_t b) { return mEntries[a].block < mEntries[b].block; });
+
+    bool result = true;
+    for (uint32_t i = 0; i < numDirty; i++) {
+        const int32_t idx = mFlushOrder[i];
+        if (!writeBackEntry(idx)) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to write back block %d", mEntries[idx].block);
+            result = false;
+        }
+    }
+    return mLower->flush() && result;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "disc_io.h"
+#include <stdint.h>
+
+// Upper limit for the number of blocks of a DiscSectorCache
+#define DISC_CACHE_MAX_BLOCKS 0x10000
+
+/**
+ * LRU cache of fixed size sector blocks that sits on top of another DiscSectorIO.
+ * Small requests are served from / collected in the cache, large requests bypass it.
+ * In write-back mode, modified blocks are only written to the lower layer on eviction or flush().
+ *
+ * Not thread safe, the caller has to serialize the access.
+ */
+class DiscSectorCache : public DiscSectorIO {
+public:
+    explicit DiscSectorCache(DiscSectorIO *lower) : mLower(lower) {}
+
+    ~DiscSectorCache() override;
+
+    /**
+     * (Re)configures the cache. Existing dirty blocks are written back before.
+     * @param numBlocks number of blocks that can be cached. 0 disables the cache.
+     * @param sectorsPerBlock number of sectors in a block
+     * @param sectorSize size of a sector in bytes
+     * @param writeBack if false, writes are passed through to the lower layer immediately
+     * @return false if writing back dirty blocks or allocating the cache failed.
+     */
+    bool configure(uint32_t numBlocks, uint32_t sectorsPerBlock, uint32_t sectorSize, bool writeBack);
+
+    // Returns false if the cache would exceed DISC_CACHE_MAX_BLOCKS or DISC_IO_MAX_BUFFER_SIZE.
+    static bool isValidSize(uint32_t numBlocks, uint32_t sectorsPerBlock, uint32_t sectorSize);
+
+    // Reallocates the cache for a different sector size, keeps the other settings.
+    bool setSectorSize(uint32_t sectorSize);
+
+    [[nodiscard]] bool isEnabled() const { return mNumBlocks > 0; }
+
+    bool readSectors(uint32_t sector, uint32_t numSectors, void *buffer) override;
+
+    bool writeSectors(uint32_t sector, uint32_t numSectors, const void *buffer) override;
+
+    bool flush() override;
+
+    // Drops all cached blocks without writing them back.
+    void invalidate();
+
+    uint32_t hits       = 0;
+    uint32_t misses     = 0;
+    uint32_t writeBacks = 0;
+    uint32_t bypasses   = 0;
+
+private:
+    struct Entry {
+        uint32_t block;
+        int32_t hashNext;
+        int32_t lruPrev;
+        int32_t lruNext;
+        bool valid;
+        bool dirty;
+    };
+
+    void release();
+
+    [[nodiscard]] uint8_t *blockData(int32_t idx) const { return mData + idx * mSectorsPerBlock * mSectorSize; }
+
+    [[nodiscard]] uint32_t hashBucket(uint32_t block) const { return (block * 2654435761u) & (mNumBuckets - 1); }
+
+    int32_t lookup(uint32_t block) const;
+
+    void hashInsert(int32_t idx);
+
+    void hashRemove(int32_t idx);
+
+    void lruUnlink(int32_t idx);
+
+    void lruPushFront(int32_t idx);
+
+    void lruPushBack(int32_t idx);
+
+    int32_t acquireSlot(uint32_t block);
+
+    void dropSlot(int32_t idx);
+
+    int32_t loadBlock(uint32_t block);
+
+    bool writeBackEntry(int32_t idx);
+
+    bool flushRange(uint32_t sector, uint32_t numSectors);
+
+    void updateCached(uint32_t sector, uint32_t numSectors, const uint8_t *buffer);
+
+    DiscSectorIO *mLower;
+
+    uint8_t *mData            = nullptr;
+    Entry *mEntries           = nullptr;
+    int32_t *mBuckets         = nullptr;
+    int32_t *mFlushOrder      = nullptr;
+    uint32_t mNumBuckets      = 0;
+    uint32_t mNumBlocks       = 0;
+    uint32_t mSectorsPerBlock = 0;
+    uint32_t mSectorSize      = 0;
+    bool mWriteBack           = false;
+    int32_t mLruHead          = -1;
+    int32_t mLruTail          = -1;
+};
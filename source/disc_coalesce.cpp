@@ -0,0 +1,116 @@
+#include "disc_coalesce.h"
+#include "logger.h"
+#include <algorithm>
+#include <cstring>
+#include <malloc.h>
+
+DiscWriteCoalescer::~DiscWriteCoalescer() {
+    release();
+}
+
+void DiscWriteCoalescer::release() {
+    free(mData);
+    mData       = nullptr;
+    mMaxSectors = 0;
+    mCount      = 0;
+}
+
+bool DiscWriteCoalescer::isValidSize(uint32_t maxSectors, uint32_t sectorSize) {
+    return maxSectors == 0 || sectorSize == 0 || DiscBufferSizeValid(maxSectors, sectorSize);
+}
+
+bool DiscWriteCoalescer::configure(uint32_t maxSectors, uint32_t sectorSize) {
+    if (!isValidSize(maxSectors, sectorSize)) {
+        DEBUG_FUNCTION_LINE_ERR("Write coalescing buffer of %d sectors of %d bytes is too large", maxSectors, sectorSize);
+        return false;
+    }
+    if (!flushPending()) {
+        return false;
+    }
+    release();
+    if (maxSectors == 0 || sectorSize == 0) {
+        return true;
+    }
+
+    mData = (uint8_t *) memalign(0x40, maxSectors * sectorSize);
+    if (!mData) {
+        DEBUG_FUNCTION_LINE_ERR("Failed to allocate write coalescing buffer (%d sectors)", maxSectors);
+        return false;
+    }
+    mMaxSectors = maxSectors;
+    mSectorSize = sectorSize;
+    return true;
+}
+
+bool DiscWriteCoalescer::setSectorSize(uint32_t sectorSize) {
+    if (!isEnabled() || sectorSize == mSectorSize) {
+        return true;
+    }
+    return configure(mMaxSectors, sectorSize);
+}
+
+bool DiscWriteCoalescer::flushPending() {
+    if (mCount == 0) {
+        return true;
+    }
+    if (!mLower->writeSectors(mStart, mCount, mData)) {
+        DEBUG_FUNCTION_LINE_ERR("Failed to write %d coalesced sectors at %d", mCount, mStart);
+        return false;
+    }
+    mCount = 0;
+    flushes++;
+    return true;
+}
+
+bool DiscWriteCoalescer::readSectors(uint32_t sector, uint32_t numSectors, void *buffer) {
+    if (mCount > 0 && sector < (uint64_t) mStart + mCount && (uint64_t) sector + numSectors > mStart) {
+        // The device doesn't have the latest data of this range yet.
+        if (!flushPending()) {
+            return false;
+        }
+    }
+    return mLower->readSectors(sector, numSectors, buffer);
+}
+
+bool DiscWriteCoalescer::writeSectors(uint32_t sector, uint32_t numSectors, const void *buffer) {
+    if (!isEnabled()) {
+        return mLower->writeSectors(sector, numSectors, buffer);
+    }
+
+    if (mCount > 0) {
+        const uint64_t end        = (uint64_t) sector + numSectors;
+        const uint64_t pendingEnd = (uint64_t) mStart + mCount;
+        const uint32_t newStart   = std::min(mStart, sector);
+        const uint64_t newEnd     = std::max(pendingEnd, end);
+        if (sector <= pendingEnd && end >= mStart && newEnd - newStart <= mMaxSectors) {
+            // Contiguous or overlapping, merge it into the pending range.
+            if (newStart < mStart) {
+                memmove(mData + (mStart - newStart) * mSectorSize, mData, mCount * mSectorSize);
+            }
+            memcpy(mData + (sector - newStart) * mSectorSize, buffer, numSectors * mSectorSize);
+            mStart = newStart;
+            mCount = newEnd - newStart;
+            merged++;
+            if (mCount == mMaxSectors) {
+                return flushPending();
+            }
+            return true;
+        }
+        if (!flushPending()) {
+            return false;
+        }
+    }
+
+    if (numSectors >= mMaxSectors) {
+        return mLower->writeSectors(sector, numSectors, buffer);
+    }
+    memcpy(mData, buffer, numSectors * mSectorSize);
+    mStart = sector;
+    mCount = numSectors;
+    return true;
+}
+
+bool DiscWriteCoalescer::flush() {
+    const bool result = flushPending();
+    return mLower->flush() && result;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "disc_io.h"
+#include <stdint.h>
+
+/**
+ * Collects contiguous and overlapping sector writes in an aligned buffer and passes them to the lower layer as one write.
+ * The pending range is written when it reaches the configured size, when a write doesn't continue it,
+ * when a read touches it and on flush().
+ *
+ * Not thread safe, the caller has to serialize the access.
+ */
+class DiscWriteCoalescer : public DiscSectorIO {
+public:
+    explicit DiscWriteCoalescer(DiscSectorIO *lower) : mLower(lower) {}
+
+    ~DiscWriteCoalescer() override;
+
+    /**
+     * (Re)configures the coalescer. Pending writes are written before.
+     * @param maxSectors maximum size of a merged write in sectors. 0 disables the coalescing.
+     * @param sectorSize size of a sector in bytes
+     * @return false if writing the pending range or allocating the buffer failed.
+     */
+    bool configure(uint32_t maxSectors, uint32_t sectorSize);
+
+    // Returns false if the buffer would exceed DISC_IO_MAX_BUFFER_SIZE.
+    static bool isValidSize(uint32_t maxSectors, uint32_t sectorSize);
+
+    // Reallocates the buffer for a different sector size, keeps the other settings.
+    bool setSectorSize(uint32_t sectorSize);
+
+    [[nodiscard]] bool isEnabled() const { return mMaxSectors > 0; }
+
+    bool readSectors(uint32_t sector, uint32_t numSectors, void *buffer) override;
+
+    bool writeSectors(uint32_t sector, uint32_t numSectors, const void *buffer) override;
+
+    bool flush() override;
+
+    //! Number of writes that have been merged into a pending range
+    uint32_t merged = 0;
+    //! Number of merged writes that have been passed to the lower layer
+    uint32_t flushes = 0;
+
+private:
+    void release();
+
+    bool flushPending();
+
+    DiscSectorIO *mLower;
+
+    uint8_t *mData       = nullptr;
+    uint32_t mMaxSectors = 0;
+    uint32_t mSectorSize = 0;
+    uint32_t mStart      = 0;
+    uint32_t mCount      = 0;
+};
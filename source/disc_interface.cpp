@@ -0,0 +1,408 @@
+/***************************************************************************
+ * Copyright (C) 2016
+ * by Dimok
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any
+ * damages arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any
+ * purpose, including commercial applications, and to alter it and
+ * redistribute it freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you
+ * must not claim that you wrote the original software. If you use
+ * this software in a product, an acknowledgment in the product
+ * documentation would be appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and
+ * must not be misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source
+ * distribution.
+ ***************************************************************************/
+#include "mocha/disc_interface.h"
+#include "disc_cache.h"
+#include "disc_coalesce.h"
+#include "disc_io.h"
+#include "disc_readahead.h"
+#include "logger.h"
+#include "mocha/fsa.h"
+#include "mocha/mocha.h"
+#include <array>
+#include <coreinit/ios.h>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+// Number of disc interfaces that can be created with Mocha_DiscInterfaceCreate
+#define MOCHA_DISC_INTERFACE_MAX_CUSTOM 8
+
+namespace {
+    struct MochaDiscDevice {
+        MochaDiscDevice() = default;
+
+        MochaDiscDevice(const char *path, const char *fallbackPath) {
+            strncpy(devicePaths[0], path, sizeof(devicePaths[0]) - 1);
+            strncpy(devicePaths[1], fallbackPath, sizeof(devicePaths[1]) - 1);
+        }
+
+        std::mutex mutex;
+        //! raw device paths that are tried in this order on startup
+        char devicePaths[2][0x40]{};
+        DiscRawSectorIO raw;
+        DiscReadAhead readAhead{&raw};
+        DiscWriteCoalescer coalescer{&readAhead};
+        DiscSectorCache cache{&coalescer};
+    };
+
+    MochaDiscDevice sdDevice("/dev/sdcard01", "");
+    MochaDiscDevice usbDevice("/dev/usb01", "/dev/usb02");
+
+    std::mutex customMutex;
+    bool customInUse[MOCHA_DISC_INTERFACE_MAX_CUSTOM];
+    MochaDiscDevice customDevices[MOCHA_DISC_INTERFACE_MAX_CUSTOM];
+
+    bool Mocha_disc_io_fsa_open(MochaDiscDevice *device) {
+        if (device->raw.fsaFd < 0) {
+            device->raw.fsaFd = IOS_Open("/dev/fsa", IOS_OPEN_READWRITE);
+            if (device->raw.fsaFd >= 0 && Mocha_UnlockFSClientEx(device->raw.fsaFd) != MOCHA_RESULT_SUCCESS) {
+                IOS_Close(device->raw.fsaFd);
+                device->raw.fsaFd = -1;
+            }
+        }
+
+        return device->raw.fsaFd >= 0;
+    }
+
+    void Mocha_disc_io_fsa_close(MochaDiscDevice *device) {
+        if (device->raw.fsaFd >= 0) {
+            IOS_Close(device->raw.fsaFd);
+            device->raw.fsaFd = -1;
+        }
+    }
+
+    void Mocha_disc_io_query_geometry(MochaDiscDevice *device, const char *devicePath) {
+        FSADeviceInfo deviceInfo;
+        FSError res;
+        if ((res = FSAGetDeviceInfo(device->raw.fsaFd, devicePath, &deviceInfo)) >= 0 && deviceInfo.deviceSectorSize > 0) {
+            device->raw.numSectors = deviceInfo.deviceSizeInSectors;
+            device->raw.sectorSize = deviceInfo.deviceSectorSize;
+        } else {
+            device->raw.numSectors = 0;
+            device->raw.sectorSize = 512;
+            DEBUG_FUNCTION_LINE_WARN("Failed to get DeviceInfo for %s: %s", devicePath, FSAGetStatusStr(res));
+        }
+
+        // Buffers that have been allocated before the device was opened might use a different sector size.
+        if (!device->cache.setSectorSize(device->raw.sectorSize) ||
+            !device->coalescer.setSectorSize(device->raw.sectorSize) ||
+            !device->readAhead.setSectorSize(device->raw.sectorSize)) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to resize buffers to a sector size of %d", device->raw.sectorSize);
+        }
+    }
+
+    bool Mocha_disc_io_startup(MochaDiscDevice *device) {
+        std::lock_guard lock(device->mutex);
+        if (!Mocha_disc_io_fsa_open(device)) {
+            return false;
+        }
+
+        if (device->raw.rawFd < 0) {
+            const char *openedPath = nullptr;
+            for (const auto &path : device->devicePaths) {
+                if (path[0] != '\0' && FSAEx_RawOpenEx(device->raw.fsaFd, path, &device->raw.rawFd) >= 0) {
+                    openedPath = path;
+                    break;
+                }
+                device->raw.rawFd = -1;
+            }
+            if (!openedPath) {
+                Mocha_disc_io_fsa_close(device);
+                return false;
+            }
+            Mocha_disc_io_query_geometry(device, openedPath);
+        }
+        return (device->raw.rawFd >= 0);
+    }
+
+    bool Mocha_disc_io_isInserted(MochaDiscDevice *device) {
+        return (device->raw.fsaFd >= 0) && (device->raw.rawFd >= 0);
+    }
+
+    bool Mocha_disc_io_clearStatus(MochaDiscDevice *device) {
+        std::lock_guard lock(device->mutex);
+        if (!Mocha_disc_io_isInserted(device)) {
+            return true;
+        }
+        return device->cache.flush();
+    }
+
+    bool Mocha_disc_io_shutdown(MochaDiscDevice *device) {
+        std::lock_guard lock(device->mutex);
+        if (!Mocha_disc_io_isInserted(device)) {
+            return false;
+        }
+
+        // Keep the device open with the dirty blocks and pending writes, so shutdown can be retried
+        if (!device->cache.flush()) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to write back cached sectors, keeping the device open");
+            return false;
+        }
+        device->cache.invalidate();
+        device->readAhead.invalidate();
+
+        FSAEx_RawCloseEx(device->raw.fsaFd, device->raw.rawFd);
+        Mocha_disc_io_fsa_close(device);
+        device->raw.rawFd = -1;
+        return true;
+    }
+
+    bool Mocha_disc_io_readSectors(MochaDiscDevice *device, uint32_t sector, uint32_t numSectors, void *buffer) {
+        std::lock_guard lock(device->mutex);
+        if (!Mocha_disc_io_isInserted(device)) {
+            return false;
+        }
+        return device->cache.readSectors(sector, numSectors, buffer);
+    }
+
+    bool Mocha_disc_io_writeSectors(MochaDiscDevice *device, uint32_t sector, uint32_t numSectors, const void *buffer) {
+        std::lock_guard lock(device->mutex);
+        if (!Mocha_disc_io_isInserted(device)) {
+            return false;
+        }
+        return device->cache.writeSectors(sector, numSectors, buffer);
+    }
+
+    /*
+     * The DISC_INTERFACE callbacks don't get a context, so every device needs its own set of functions.
+     */
+    template<MochaDiscDevice *device>
+    bool Mocha_disc_io_startup_fn(void) {
+        return Mocha_disc_io_startup(device);
+    }
+
+    template<MochaDiscDevice *device>
+    bool Mocha_disc_io_isInserted_fn(void) {
+        return Mocha_disc_io_isInserted(device);
+    }
+
+    template<MochaDiscDevice *device>
+    bool Mocha_disc_io_clearStatus_fn(void) {
+        return Mocha_disc_io_clearStatus(device);
+    }
+
+    template<MochaDiscDevice *device>
+    bool Mocha_disc_io_shutdown_fn(void) {
+        return Mocha_disc_io_shutdown(device);
+    }
+
+    template<MochaDiscDevice *device>
+    bool Mocha_disc_io_readSectors_fn(uint32_t sector, uint32_t numSectors, void *buffer) {
+        return Mocha_disc_io_readSectors(device, sector, numSectors, buffer);
+    }
+
+    template<MochaDiscDevice *device>
+    bool Mocha_disc_io_writeSectors_fn(uint32_t sector, uint32_t numSectors, const void *buffer) {
+        return Mocha_disc_io_writeSectors(device, sector, numSectors, buffer);
+    }
+
+    template<MochaDiscDevice *device>
+    constexpr DISC_INTERFACE makeDiscInterface(unsigned long ioType, unsigned long features) {
+        return {ioType,
+                features,
+                Mocha_disc_io_startup_fn<device>,
+                Mocha_disc_io_isInserted_fn<device>,
+                Mocha_disc_io_readSectors_fn<device>,
+                Mocha_disc_io_writeSectors_fn<device>,
+                Mocha_disc_io_clearStatus_fn<device>,
+                Mocha_disc_io_shutdown_fn<device>};
+    }
+
+    template<std::size_t... I>
+    std::array<DISC_INTERFACE, sizeof...(I)> makeCustomDiscInterfaces(std::index_sequence<I...>) {
+        return {makeDiscInterface<&customDevices[I]>(0, 0)...};
+    }
+
+    // ioType and features are set by Mocha_DiscInterfaceCreate
+    std::array<DISC_INTERFACE, MOCHA_DISC_INTERFACE_MAX_CUSTOM> customInterfaces = makeCustomDiscInterfaces(std::make_index_sequence<MOCHA_DISC_INTERFACE_MAX_CUSTOM>());
+} // namespace
+
+const DISC_INTERFACE Mocha_sdio_disc_interface = makeDiscInterface<&sdDevice>(DEVICE_TYPE_WII_U_SD, FEATURE_MEDIUM_CANREAD | FEATURE_MEDIUM_CANWRITE | FEATURE_WII_U_SD);
+
+const DISC_INTERFACE Mocha_usb_disc_interface = makeDiscInterface<&usbDevice>(DEVICE_TYPE_WII_U_USB, FEATURE_MEDIUM_CANREAD | FEATURE_MEDIUM_CANWRITE | FEATURE_WII_U_USB);
+
+namespace {
+    MochaDiscDevice *getDiscDevice(const DISC_INTERFACE *discInterface) {
+        if (discInterface == &Mocha_sdio_disc_interface) {
+            return &sdDevice;
+        } else if (discInterface == &Mocha_usb_disc_interface) {
+            return &usbDevice;
+        }
+        std::lock_guard lock(customMutex);
+        for (uint32_t i = 0; i < customInterfaces.size(); i++) {
+            if (discInterface == &customInterfaces[i] && customInUse[i]) {
+                return &customDevices[i];
+            }
+        }
+        return nullptr;
+    }
+} // namespace
+
+MochaUtilsStatus Mocha_DiscInterfaceCreate(const char *devicePath, const DISC_INTERFACE **outInterface) {
+    if (!devicePath || !outInterface || strlen(devicePath) >= sizeof(MochaDiscDevice::devicePaths[0])) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    std::lock_guard lock(customMutex);
+    for (uint32_t i = 0; i < customInterfaces.size(); i++) {
+        if (customInUse[i]) {
+            continue;
+        }
+        auto &device = customDevices[i];
+        strncpy(device.devicePaths[0], devicePath, sizeof(device.devicePaths[0]) - 1);
+        device.devicePaths[1][0] = '\0';
+
+        auto &discInterface = customInterfaces[i];
+        if (strncmp(devicePath, "/dev/sdcard", strlen("/dev/sdcard")) == 0) {
+            discInterface.ioType   = DEVICE_TYPE_WII_U_SD;
+            discInterface.features = FEATURE_MEDIUM_CANREAD | FEATURE_MEDIUM_CANWRITE | FEATURE_WII_U_SD;
+        } else {
+            discInterface.ioType   = DEVICE_TYPE_WII_U_USB;
+            discInterface.features = FEATURE_MEDIUM_CANREAD | FEATURE_MEDIUM_CANWRITE | FEATURE_WII_U_USB;
+        }
+        customInUse[i] = true;
+        *outInterface  = &discInterface;
+        return MOCHA_RESULT_SUCCESS;
+    }
+    return MOCHA_RESULT_MAX_CLIENT;
+}
+
+MochaUtilsStatus Mocha_DiscInterfaceDestroy(const DISC_INTERFACE *discInterface) {
+    if (discInterface == &Mocha_sdio_disc_interface || discInterface == &Mocha_usb_disc_interface) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    MochaDiscDevice *device = getDiscDevice(discInterface);
+    if (!device) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    bool inserted;
+    {
+        std::lock_guard lock(device->mutex);
+        inserted = Mocha_disc_io_isInserted(device);
+    }
+    // Don't drop cached writes that couldn't be written back
+    if (inserted && !Mocha_disc_io_shutdown(device)) {
+        return MOCHA_RESULT_UNKNOWN_ERROR;
+    }
+    {
+        std::lock_guard lock(device->mutex);
+        // Free the buffers, a new interface in this slot starts with the defaults again.
+        device->cache.configure(0, 0, device->raw.sectorSize, false);
+        device->coalescer.configure(0, device->raw.sectorSize);
+        device->readAhead.configure(0, 0, device->raw.sectorSize);
+        device->devicePaths[0][0] = '\0';
+    }
+    std::lock_guard lock(customMutex);
+    customInUse[device - customDevices] = false;
+    return MOCHA_RESULT_SUCCESS;
+}
+
+MochaUtilsStatus Mocha_DiscInterfaceSetCacheSize(const DISC_INTERFACE *discInterface, uint32_t numBlocks, uint32_t sectorsPerBlock, bool writeBack) {
+    MochaDiscDevice *device = getDiscDevice(discInterface);
+    if (!device) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    std::lock_guard lock(device->mutex);
+    if (!DiscSectorCache::isValidSize(numBlocks, sectorsPerBlock, device->raw.sectorSize)) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    if (!device->cache.configure(numBlocks, sectorsPerBlock, device->raw.sectorSize, writeBack)) {
+        return numBlocks > 0 ? MOCHA_RESULT_OUT_OF_MEMORY : MOCHA_RESULT_UNKNOWN_ERROR;
+    }
+    return MOCHA_RESULT_SUCCESS;
+}
+
+MochaUtilsStatus Mocha_DiscInterfaceSetReadAhead(const DISC_INTERFACE *discInterface, uint32_t minSectors, uint32_t maxSectors) {
+    MochaDiscDevice *device = getDiscDevice(discInterface);
+    if (!device) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    std::lock_guard lock(device->mutex);
+    if (!DiscReadAhead::isValidSize(minSectors, maxSectors, device->raw.sectorSize)) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    if (!device->readAhead.configure(minSectors, maxSectors, device->raw.sectorSize)) {
+        return MOCHA_RESULT_OUT_OF_MEMORY;
+    }
+    return MOCHA_RESULT_SUCCESS;
+}
+
+MochaUtilsStatus Mocha_DiscInterfaceSetWriteCoalescing(const DISC_INTERFACE *discInterface, uint32_t maxSectors) {
+    MochaDiscDevice *device = getDiscDevice(discInterface);
+    if (!device) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    std::lock_guard lock(device->mutex);
+    if (!DiscWriteCoalescer::isValidSize(maxSectors, device->raw.sectorSize)) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    if (!device->coalescer.configure(maxSectors, device->raw.sectorSize)) {
+        return MOCHA_RESULT_OUT_OF_MEMORY;
+    }
+    return MOCHA_RESULT_SUCCESS;
+}
+
+MochaUtilsStatus Mocha_DiscInterfaceGetGeometry(const DISC_INTERFACE *discInterface, MochaDiscInterfaceGeometry *outGeometry) {
+    MochaDiscDevice *device = getDiscDevice(discInterface);
+    if (!device || !outGeometry) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    std::lock_guard lock(device->mutex);
+    if (!Mocha_disc_io_isInserted(device)) {
+        return MOCHA_RESULT_NOT_FOUND;
+    }
+    outGeometry->sectorSize         = device->raw.sectorSize;
+    outGeometry->numSectors         = device->raw.numSectors;
+    outGeometry->maxTransferSectors = device->raw.maxTransferSectors;
+    return MOCHA_RESULT_SUCCESS;
+}
+
+MochaUtilsStatus Mocha_DiscInterfaceSetMaxTransferSize(const DISC_INTERFACE *discInterface, uint32_t maxSectors) {
+    MochaDiscDevice *device = getDiscDevice(discInterface);
+    if (!device) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    std::lock_guard lock(device->mutex);
+    device->raw.maxTransferSectors = maxSectors;
+    return MOCHA_RESULT_SUCCESS;
+}
+
+MochaUtilsStatus Mocha_DiscInterfaceFlush(const DISC_INTERFACE *discInterface) {
+    MochaDiscDevice *device = getDiscDevice(discInterface);
+    if (!device) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    return Mocha_disc_io_clearStatus(device) ? MOCHA_RESULT_SUCCESS : MOCHA_RESULT_UNKNOWN_ERROR;
+}
+
+MochaUtilsStatus Mocha_DiscInterfaceGetStats(const DISC_INTERFACE *discInterface, MochaDiscInterfaceStats *outStats) {
+    MochaDiscDevice *device = getDiscDevice(discInterface);
+    if (!device || !outStats) {
+        return MOCHA_RESULT_INVALID_ARGUMENT;
+    }
+    std::lock_guard lock(device->mutex);
+    outStats->cacheHits           = device->cache.hits;
+    outStats->cacheMisses         = device->cache.misses;
+    outStats->cacheWriteBacks     = device->cache.writeBacks;
+    outStats->cacheBypasses       = device->cache.bypasses;
+    outStats->readAheadHits       = device->readAhead.hits;
+    outStats->readAheadPrefetches = device->readAhead.prefetches;
+    outStats->readAheadWaits      = device->readAhead.waits;
+    outStats->readAheadDiscarded  = device->readAhead.discarded;
+    outStats->readAheadWindow     = device->readAhead.currentWindow();
+    outStats->coalescedWrites     = device->coalescer.merged;
+    outStats->coalescerFlushes    = device->coalescer.flushes;
+    outStats->rawReads            = device->raw.readRequests;
+    outStats->rawWrites           = device->raw.writeRequests;
+    return MOCHA_RESULT_SUCCESS;
+}
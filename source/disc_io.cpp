@@ -0,0 +1,38 @@
+#include "disc_io.h"
+#include "logger.h"
+#include "mocha/fsa.h"
+#include <algorithm>
+
+bool DiscRawSectorIO::readSectors(uint32_t sector, uint32_t numSectors, void *buffer) {
+    auto *out = (uint8_t *) buffer;
+    while (numSectors > 0) {
+        const uint32_t count = maxTransferSectors ? std::min(numSectors, maxTransferSectors) : numSectors;
+        readRequests++;
+        FSError res = FSAEx_RawReadEx(fsaFd, out, sectorSize, count, sector, rawFd);
+        if (res < 0) {
+            DEBUG_FUNCTION_LINE_ERR("FSAEx_RawReadEx(0x%08X, %p, %d, %d, %d, 0x%08X) failed: %s", fsaFd, out, sectorSize, count, sector, rawFd, FSAGetStatusStr(res));
+            return false;
+        }
+        out += count * sectorSize;
+        sector += count;
+        numSectors -= count;
+    }
+    return true;
+}
+
+bool DiscRawSectorIO::writeSectors(uint32_t sector, uint32_t numSectors, const void *buffer) {
+    auto *in = (const uint8_t *) buffer;
+    while (numSectors > 0) {
+        const uint32_t count = maxTransferSectors ? std::min(numSectors, maxTransferSectors) : numSectors;
+        writeRequests++;
+        FSError res = FSAEx_RawWriteEx(fsaFd, in, sectorSize, count, sector, rawFd);
+        if (res < 0) {
+            DEBUG_FUNCTION_LINE_ERR("FSAEx_RawWriteEx(0x%08X, %p, %d, %d, %d, 0x%08X) failed: %s", fsaFd, in, sectorSize, count, sector, rawFd, FSAGetStatusStr(res));
+            return false;
+        }
+        in += count * sectorSize;
+        sector += count;
+        numSectors -= count;
+    }
+    return true;
+}
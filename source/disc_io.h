@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+
+// Upper limit for a single buffer of one of the caching layers in bytes
+#define DISC_IO_MAX_BUFFER_SIZE 0x4000000
+
+// Returns true if numSectors sectors of sectorSize bytes fit into DISC_IO_MAX_BUFFER_SIZE, without overflowing.
+inline bool DiscBufferSizeValid(uint64_t numSectors, uint32_t sectorSize) {
+    return sectorSize > 0 && numSectors <= DISC_IO_MAX_BUFFER_SIZE / sectorSize;
+}
+
+/**
+ * Interface for everything that can read and write sectors of a raw device.
+ * Used to stack the different layers (e.g. caching) of the disc interfaces.
+ */
+class DiscSectorIO {
+public:
+    virtual ~DiscSectorIO() = default;
+
+    virtual bool readSectors(uint32_t sector, uint32_t numSectors, void *buffer) = 0;
+
+    virtual bool writeSectors(uint32_t sector, uint32_t numSectors, const void *buffer) = 0;
+
+    // Writes back everything that has been buffered by this layer.
+    virtual bool flush() { return true; }
+};
+
+/**
+ * Bottom layer, forwards every request to FSAEx_RawReadEx/FSAEx_RawWriteEx.
+ * Requests larger than maxTransferSectors are split into multiple transfers.
+ */
+class DiscRawSectorIO : public DiscSectorIO {
+public:
+    bool readSectors(uint32_t sector, uint32_t numSectors, void *buffer) override;
+
+    bool writeSectors(uint32_t sector, uint32_t numSectors, const void *buffer) override;
+
+    //! /dev/fsa handle with unlocked permissions
+    int fsaFd = -1;
+    //! raw device handle
+    int rawFd = -1;
+    //! native sector size of the device, all sector numbers and counts are in this unit
+    uint32_t sectorSize = 512;
+    //! size of the device in sectors, 0 if unknown
+    uint64_t numSectors = 0;
+    //! maximum number of sectors per transfer, 0 for no limit
+    uint32_t maxTransferSectors = 0;
+
+    uint32_t readRequests  = 0;
+    uint32_t writeRequests = 0;
+};
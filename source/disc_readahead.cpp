@@ -0,0 +1,228 @@
+#include "disc_readahead.h"
+#include "logger.h"
+#include "mocha/fsa.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <malloc.h>
+#include <utility>
+
+DiscReadAhead::DiscReadAhead(DiscRawSectorIO *raw) : mRaw(raw) {
+    OSInitMessageQueueEx(&mQueue, mMessages, std::size(mMessages), "DiscReadAhead");
+}
+
+DiscReadAhead::~DiscReadAhead() {
+    release();
+}
+
+void DiscReadAhead::release() {
+    invalidate();
+    free(mCurrent.data);
+    free(mNext.data);
+    mCurrent    = {};
+    mNext       = {};
+    mMinSectors = 0;
+    mMaxSectors = 0;
+    mWindow     = 0;
+}
+
+bool DiscReadAhead::isValidSize(uint32_t minSectors, uint32_t maxSectors, uint32_t sectorSize) {
+    if (maxSectors == 0 || sectorSize == 0) {
+        return true;
+    }
+    return minSectors <= maxSectors && DiscBufferSizeValid(maxSectors, sectorSize);
+}
+
+bool DiscReadAhead::configure(uint32_t minSectors, uint32_t maxSectors, uint32_t sectorSize) {
+    if (!isValidSize(minSectors, maxSectors, sectorSize)) {
+        DEBUG_FUNCTION_LINE_ERR("Invalid readahead window of %d to %d sectors of %d bytes", minSectors, maxSectors, sectorSize);
+        return false;
+    }
+    release();
+    if (maxSectors == 0 || sectorSize == 0) {
+        return true;
+    }
+    if (minSectors == 0) {
+        minSectors = maxSectors;
+    }
+
+    mCurrent.data = (uint8_t *) memalign(0x40, maxSectors * sectorSize);
+    mNext.data    = (uint8_t *) memalign(0x40, maxSectors * sectorSize);
+    if (!mCurrent.data || !mNext.data) {
+        DEBUG_FUNCTION_LINE_ERR("Failed to allocate readahead buffers (%d sectors)", maxSectors);
+        release();
+        return false;
+    }
+    mSectorSize = sectorSize;
+    mMinSectors = minSectors;
+    mMaxSectors = maxSectors;
+    mWindow     = minSectors;
+    return true;
+}
+
+bool DiscReadAhead::setSectorSize(uint32_t sectorSize) {
+    if (!isEnabled() || sectorSize == mSectorSize) {
+        return true;
+    }
+    return configure(mMinSectors, mMaxSectors, sectorSize);
+}
+
+bool DiscReadAhead::waitForPrefetch() {
+    if (!mPrefetchInFlight) {
+        return mNext.valid;
+    }
+    OSMessage message;
+    OSReceiveMessage(&mQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+    mPrefetchInFlight = false;
+    if (FSAEx_RawAsyncHandleMessage(&message, nullptr) < 0) {
+        // e.g. the window exceeded the end of the device
+        mNext.valid = false;
+    }
+    return mNext.valid;
+}
+
+void DiscReadAhead::invalidate() {
+    waitForPrefetch();
+    if (mNext.valid) {
+        discarded++;
+    }
+    mCurrent.valid = false;
+    mNext.valid    = false;
+}
+
+void DiscReadAhead::startPrefetch(uint32_t sector) {
+    if (mPrefetchInFlight || mNext.valid) {
+        if (mNext.start == sector) {
+            return;
+        }
+        // Drop the old prefetch, we can't have more than one in flight.
+        waitForPrefetch();
+        if (mNext.valid) {
+            discarded++;
+        }
+    }
+    mNext.valid = false;
+
+    uint32_t count = std::min(mWindow, UINT32_MAX - sector);
+    if (mRaw->maxTransferSectors > 0) {
+        // The async read isn't split by the raw layer
+        count = std::min(count, mRaw->maxTransferSectors);
+    }
+    if (count == 0) {
+        return;
+    }
+
+    FSAExAsyncData asyncData{};
+    asyncData.ioMsgQueue = &mQueue;
+    if (FSAEx_RawReadAsync(mRaw->fsaFd, mNext.data, mSectorSize, count, sector, mRaw->rawFd, &asyncData) < 0) {
+        return;
+    }
+    mNext.start       = sector;
+    mNext.count       = count;
+    mNext.valid       = true;
+    mPrefetchInFlight = true;
+    mRaw->readRequests++;
+    prefetches++;
+}
+
+bool DiscReadAhead::fillCurrent(uint32_t sector, uint32_t numSectors) {
+    mCurrent.valid = false;
+    if (!mRaw->readSectors(sector, numSectors, mCurrent.data)) {
+        return false;
+    }
+    mCurrent.start = sector;
+    mCurrent.count = numSectors;
+    mCurrent.valid = true;
+    return true;
+}
+
+bool DiscReadAhead::readSectors(uint32_t sector, uint32_t numSectors, void *buffer) {
+    if (!isEnabled()) {
+        return mRaw->readSectors(sector, numSectors, buffer);
+    }
+
+    const bool sequential = (sector == mNextExpected);
+    mNextExpected         = sector + numSectors;
+    if (sequential) {
+        mStreak++;
+    } else {
+        mStreak = 0;
+        mWindow = mMinSectors;
+    }
+    const bool readAhead = sequential && mStreak >= 1;
+
+    auto *out       = (uint8_t *) buffer;
+    bool servedHere = false;
+    while (numSectors > 0) {
+        if (contains(mCurrent, sector)) {
+            const uint32_t offset = sector - mCurrent.start;
+            const uint32_t count  = std::min(numSectors, mCurrent.count - offset);
+            memcpy(out, mCurrent.data + offset * mSectorSize, count * mSectorSize);
+            servedHere = true;
+
+            out += count * mSectorSize;
+            sector += count;
+            numSectors -= count;
+            continue;
+        }
+
+        if ((mPrefetchInFlight || mNext.valid) && mNext.start == sector) {
+            // The next window has been requested already, use it.
+            if (mPrefetchInFlight) {
+                waits++;
+            }
+            if (waitForPrefetch()) {
+                std::swap(mCurrent, mNext);
+                mNext.valid = false;
+                mWindow     = std::min(mWindow * 2, mMaxSectors);
+                continue;
+            }
+        }
+
+        if (!readAhead || numSectors >= mMaxSectors) {
+            // Random access or too large for the buffers, read directly.
+            if (!mRaw->readSectors(sector, numSectors, out)) {
+                return false;
+            }
+            break;
+        }
+
+        if (!fillCurrent(sector, std::min(std::max(numSectors, mWindow), UINT32_MAX - sector))) {
+            // Might have exceeded the end of the device, try again without readahead.
+            if (!mRaw->readSectors(sector, numSectors, out)) {
+                return false;
+            }
+            break;
+        }
+    }
+
+    if (servedHere) {
+        hits++;
+    }
+
+    if (readAhead) {
+        // Make sure the window after the data we already have is on its way.
+        startPrefetch(contains(mCurrent, mNextExpected) ? mCurrent.start + mCurrent.count : mNextExpected);
+    }
+    return true;
+}
+
+bool DiscReadAhead::writeSectors(uint32_t sector, uint32_t numSectors, const void *buffer) {
+    if (isEnabled()) {
+        const uint64_t end = (uint64_t) sector + numSectors;
+        // Wait for a pending prefetch, it might return the old data.
+        if (mPrefetchInFlight && mNext.start < end && (uint64_t) mNext.start + mNext.count > sector) {
+            waitForPrefetch();
+            mNext.valid = false;
+            discarded++;
+        }
+        if (mNext.valid && mNext.start < end && (uint64_t) mNext.start + mNext.count > sector) {
+            mNext.valid = false;
+            discarded++;
+        }
+        if (mCurrent.valid && mCurrent.start < end && (uint64_t) mCurrent.start + mCurrent.count > sector) {
+            mCurrent.valid = false;
+        }
+    }
+    return mRaw->writeSectors(sector, numSectors, buffer);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "disc_io.h"
+#include <coreinit/messagequeue.h>
+#include <stdint.h>
+
+/**
+ * Detects sequential reads and prefetches the following sectors into aligned buffers.
+ * While the caller consumes the current window, the next window is already read asynchronously.
+ * The window starts at minSectors and is doubled every time a prefetched window is used, up to maxSectors.
+ *
+ * Not thread safe, the caller has to serialize the access.
+ */
+class DiscReadAhead : public DiscSectorIO {
+public:
+    explicit DiscReadAhead(DiscRawSectorIO *raw);
+
+    ~DiscReadAhead() override;
+
+    /**
+     * (Re)configures the readahead. Drops all prefetched data.
+     * @param minSectors initial size of the window in sectors
+     * @param maxSectors maximum size of the window in sectors. 0 disables the readahead.
+     * @param sectorSize size of a sector in bytes
+     * @return false if allocating the buffers failed.
+     */
+    bool configure(uint32_t minSectors, uint32_t maxSectors, uint32_t sectorSize);
+
+    // Returns false if minSectors is larger than maxSectors or a window buffer would exceed DISC_IO_MAX_BUFFER_SIZE.
+    static bool isValidSize(uint32_t minSectors, uint32_t maxSectors, uint32_t sectorSize);
+
+    // Reallocates the buffers for a different sector size, keeps the window settings.
+    bool setSectorSize(uint32_t sectorSize);
+
+    [[nodiscard]] bool isEnabled() const { return mMaxSectors > 0; }
+
+    bool readSectors(uint32_t sector, uint32_t numSectors, void *buffer) override;
+
+    bool writeSectors(uint32_t sector, uint32_t numSectors, const void *buffer) override;
+
+    // Waits for a pending prefetch and drops all prefetched data.
+    void invalidate();
+
+    [[nodiscard]] uint32_t currentWindow() const { return mWindow; }
+
+    //! Number of requests that have been (partially) served from prefetched data
+    uint32_t hits = 0;
+    //! Number of asynchronous prefetches that have been issued
+    uint32_t prefetches = 0;
+    //! Number of times a read had to wait for a prefetch to finish
+    uint32_t waits = 0;
+    //! Number of prefetched windows that were dropped without being used
+    uint32_t discarded = 0;
+
+private:
+    struct Window {
+        uint8_t *data;
+        uint32_t start;
+        uint32_t count;
+        bool valid;
+    };
+
+    void release();
+
+    bool waitForPrefetch();
+
+    void startPrefetch(uint32_t sector);
+
+    bool fillCurrent(uint32_t sector, uint32_t numSectors);
+
+    [[nodiscard]] static bool contains(const Window &window, uint32_t sector) {
+        return window.valid && sector >= window.start && sector - window.start < window.count;
+    }
+
+    DiscRawSectorIO *mRaw;
+
+    Window mCurrent{};
+    Window mNext{};
+    bool mPrefetchInFlight = false;
+
+    uint32_t mSectorSize   = 0;
+    uint32_t mMinSectors   = 0;
+    uint32_t mMaxSectors   = 0;
+    uint32_t mWindow       = 0;
+    uint32_t mNextExpected = 0;
+    uint32_t mStreak       = 0;
+
+    OSMessageQueue mQueue{};
+    OSMessage mMessages[2]{};
+};
@@ -1,11 +1,86 @@
 #include "mocha/fsa.h"
+#include "fsa_shim_pool.h"
 #include "logger.h"
 #include "utils.h"
 #include <coreinit/debug.h>
 #include <coreinit/filesystem.h>
 #include <coreinit/filesystem_fsa.h>
+#include <coreinit/ios.h>
+#include <coreinit/messagequeue.h>
 #include <cstring>
 #include <malloc.h>
+#include <mutex>
+
+// Upper limit for the bounce buffer that is used when transferring from/to a misaligned buffer.
+#define FSA_RAW_BOUNCE_BUFFER_SIZE 0x20000
+
+namespace {
+    // Sends a single raw read/write. "data" is expected to be 0x40 aligned.
+    FSError RawTransfer(FSAClientHandle clientHandle, FSACommandEnum command, void *data, uint32_t size_bytes, uint32_t cnt, uint64_t blocks_offset, int device_handle) {
+        auto *shim = FSAShimPool_Acquire(clientHandle, command);
+        if (!shim) {
+            return FS_ERROR_INVALID_BUFFER;
+        }
+
+        shim->ioctlvVec[1].vaddr = data;
+        shim->ioctlvVec[1].len   = size_bytes * cnt;
+
+        // raw read and raw write requests share the same layout
+        auto &request         = shim->request.rawRead;
+        request.blocks_offset = blocks_offset;
+        request.count         = cnt;
+        request.size          = size_bytes;
+        request.device_handle = device_handle;
+
+        auto res = __FSAShimSend(shim, 0);
+
+        FSAShimPool_Release(shim);
+        return res;
+    }
+
+    // Transfers a misaligned buffer in chunks of at most FSA_RAW_BOUNCE_BUFFER_SIZE bytes via an aligned bounce buffer.
+    FSError RawTransferBounced(FSAClientHandle clientHandle, FSACommandEnum command, void *data, uint32_t size_bytes, uint32_t cnt, uint64_t blocks_offset, int device_handle) {
+        if (size_bytes == 0 || cnt == 0) {
+            return RawTransfer(clientHandle, command, data, size_bytes, cnt, blocks_offset, device_handle);
+        }
+        uint32_t sectorsPerChunk = FSA_RAW_BOUNCE_BUFFER_SIZE / size_bytes;
+        if (sectorsPerChunk == 0) {
+            sectorsPerChunk = 1;
+        }
+        if (sectorsPerChunk > cnt) {
+            sectorsPerChunk = cnt;
+        }
+
+        auto *bounceBuffer = (uint8_t *) memalign(0x40, ROUNDUP(size_bytes * sectorsPerChunk, 0x40));
+        if (!bounceBuffer) {
+            DEBUG_FUNCTION_LINE_ERR("Buffer not aligned (%p).", data);
+            return FS_ERROR_INVALID_ALIGNMENT;
+        }
+
+        auto *buffer = (uint8_t *) data;
+        FSError res  = FS_ERROR_OK;
+        while (cnt > 0) {
+            const uint32_t curCnt  = cnt < sectorsPerChunk ? cnt : sectorsPerChunk;
+            const uint32_t curSize = curCnt * size_bytes;
+            if (command == FSA_COMMAND_RAW_WRITE) {
+                memcpy(bounceBuffer, buffer, curSize);
+            }
+            res = RawTransfer(clientHandle, command, bounceBuffer, size_bytes, curCnt, blocks_offset, device_handle);
+            if (res < 0) {
+                break;
+            }
+            if (command == FSA_COMMAND_RAW_READ) {
+                memcpy(buffer, bounceBuffer, curSize);
+            }
+            buffer += curSize;
+            blocks_offset += curCnt;
+            cnt -= curCnt;
+        }
+
+        free(bounceBuffer);
+        return res;
+    }
+} // namespace
 
 FSError FSAEx_RawOpen(FSClient *client, const char *device_path, int32_t *outHandle) {
     if (!client) {
@@ -21,16 +96,11 @@ FSError FSAEx_RawOpenEx(int clientHandle, const char *device_path, int32_t *outH
     if (!device_path) {
         return FS_ERROR_INVALID_PATH;
     }
-    auto *shim = (FSAShimBuffer *) memalign(0x40, sizeof(FSAShimBuffer));
+    auto *shim = FSAShimPool_Acquire(clientHandle, FSA_COMMAND_RAW_OPEN);
     if (!shim) {
         return FS_ERROR_INVALID_BUFFER;
     }
 
-    shim->clientHandle   = clientHandle;
-    shim->command        = FSA_COMMAND_RAW_OPEN;
-    shim->ipcReqType     = FSA_IPC_REQUEST_IOCTL;
-    shim->response.word0 = 0xFFFFFFFF;
-
     FSARequestRawOpen *requestBuffer = &shim->request.rawOpen;
 
     strncpy(requestBuffer->path, device_path, 0x27F);
@@ -39,7 +109,7 @@ FSError FSAEx_RawOpenEx(int clientHandle, const char *device_path, int32_t *outH
     if (res >= 0) {
         *outHandle = shim->response.rawOpen.handle;
     }
-    free(shim);
+    FSAShimPool_Release(shim);
     return res;
 }
 
@@ -51,16 +121,11 @@ FSError FSAEx_RawClose(FSClient *client, int32_t device_handle) {
 }
 
 FSError FSAEx_RawCloseEx(int clientHandle, int32_t device_handle) {
-    auto *buffer = (FSAShimBuffer *) memalign(0x40, sizeof(FSAShimBuffer));
+    auto *buffer = FSAShimPool_Acquire(clientHandle, FSA_COMMAND_RAW_CLOSE);
     if (!buffer) {
         return FS_ERROR_INVALID_BUFFER;
     }
 
-    buffer->clientHandle   = clientHandle;
-    buffer->command        = FSA_COMMAND_RAW_CLOSE;
-    buffer->ipcReqType     = FSA_IPC_REQUEST_IOCTL;
-    buffer->response.word0 = 0xFFFFFFFF;
-
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Waddress-of-packed-member"
     auto *requestBuffer = &buffer->request.rawClose;
@@ -69,7 +134,7 @@ FSError FSAEx_RawCloseEx(int clientHandle, int32_t device_handle) {
     requestBuffer->handle = device_handle;
 
     auto res = __FSAShimSend(buffer, 0);
-    free(buffer);
+    FSAShimPool_Release(buffer);
     return res;
 }
 
@@ -84,55 +149,34 @@ FSError FSAEx_RawReadEx(int clientHandle, void *data, uint32_t size_bytes, uint3
     if (data == nullptr) {
         return FS_ERROR_INVALID_BUFFER;
     }
-    auto *shim = (FSAShimBuffer *) memalign(0x40, sizeof(FSAShimBuffer));
-    if (!shim) {
-        return FS_ERROR_INVALID_BUFFER;
+    if (((uintptr_t) data & 0x3F) == 0) {
+        return RawTransfer(clientHandle, FSA_COMMAND_RAW_READ, data, size_bytes, cnt, blocks_offset, device_handle);
     }
 
-    shim->clientHandle = clientHandle;
-    shim->ipcReqType   = FSA_IPC_REQUEST_IOCTLV;
-    shim->command      = FSA_COMMAND_RAW_READ;
+    DEBUG_FUNCTION_LINE_WARN("Buffer not aligned (%p). Align to 0x40 for best performance", data);
 
-    shim->ioctlvVecIn  = uint8_t{1};
-    shim->ioctlvVecOut = uint8_t{2};
-
-    shim->ioctlvVec[0].vaddr = &shim->request;
-    shim->ioctlvVec[0].len   = sizeof(FSARequest);
-
-    auto *tmp = data;
+    // Read as many sectors as possible into the next aligned address of the callers buffer and move them into
+    // place afterwards. Only the remaining sector(s) at the end need to go through a bounce buffer.
+    auto *buffer         = (uint8_t *) data;
+    const uint32_t shift = 0x40 - ((uintptr_t) data & 0x3F);
+    const uint32_t total = size_bytes * cnt;
+    uint32_t directCnt   = 0;
+    if (size_bytes > 0 && total > shift) {
+        directCnt = (total - shift) / size_bytes;
+    }
 
-    if ((uint32_t) data & 0x3F) {
-        auto *alignedBuffer = memalign(0x40, ROUNDUP(size_bytes * cnt, 0x40));
-        if (!alignedBuffer) {
-            DEBUG_FUNCTION_LINE_ERR("Buffer not aligned (%p).", data);
-            return FS_ERROR_INVALID_ALIGNMENT;
+    if (directCnt > 0) {
+        auto res = RawTransfer(clientHandle, FSA_COMMAND_RAW_READ, buffer + shift, size_bytes, directCnt, blocks_offset, device_handle);
+        if (res < 0) {
+            return res;
         }
-        DEBUG_FUNCTION_LINE_WARN("Buffer not aligned (%p). Align to 0x40 for best performance", data);
-        tmp = alignedBuffer;
+        memmove(buffer, buffer + shift, size_bytes * directCnt);
     }
 
-    shim->ioctlvVec[1].vaddr = (void *) tmp;
-    shim->ioctlvVec[1].len   = size_bytes * cnt;
-
-    shim->ioctlvVec[2].vaddr = &shim->response;
-    shim->ioctlvVec[2].len   = sizeof(FSAResponse);
-
-    auto &request         = shim->request.rawRead;
-    request.blocks_offset = blocks_offset;
-    request.count         = cnt;
-    request.size          = size_bytes;
-    request.device_handle = device_handle;
-
-    auto res = __FSAShimSend(shim, 0);
-    if (res >= 0 && tmp != data) {
-        memcpy(data, tmp, size_bytes * cnt);
-    }
-    if (tmp != data) {
-        free(tmp);
+    if (directCnt == cnt) {
+        return FS_ERROR_OK;
     }
-
-    free(shim);
-    return res;
+    return RawTransferBounced(clientHandle, FSA_COMMAND_RAW_READ, buffer + size_bytes * directCnt, size_bytes, cnt - directCnt, blocks_offset + directCnt, device_handle);
 }
 
 FSError FSAEx_RawWrite(FSClient *client, const void *data, uint32_t size_bytes, uint32_t cnt, uint64_t blocks_offset, int device_handle) {
@@ -143,51 +187,204 @@ FSError FSAEx_RawWrite(FSClient *client, const void *data, uint32_t size_bytes,
 }
 
 FSError FSAEx_RawWriteEx(int clientHandle, const void *data, uint32_t size_bytes, uint32_t cnt, uint64_t blocks_offset, int device_handle) {
-    auto *shim = (FSAShimBuffer *) memalign(0x40, sizeof(FSAShimBuffer));
-    if (!shim) {
+    if (data == nullptr) {
         return FS_ERROR_INVALID_BUFFER;
     }
+    if (((uintptr_t) data & 0x3F) == 0) {
+        return RawTransfer(clientHandle, FSA_COMMAND_RAW_WRITE, (void *) data, size_bytes, cnt, blocks_offset, device_handle);
+    }
 
-    shim->clientHandle = clientHandle;
-    shim->ipcReqType   = FSA_IPC_REQUEST_IOCTLV;
-    shim->command      = FSA_COMMAND_RAW_WRITE;
+    DEBUG_FUNCTION_LINE_WARN("Buffer not aligned (%p). Align to 0x40 for best performance", data);
 
-    shim->ioctlvVecIn  = uint8_t{2};
-    shim->ioctlvVecOut = uint8_t{1};
+    return RawTransferBounced(clientHandle, FSA_COMMAND_RAW_WRITE, (void *) data, size_bytes, cnt, blocks_offset, device_handle);
+}
 
-    shim->ioctlvVec[0].vaddr = &shim->request;
-    shim->ioctlvVec[0].len   = sizeof(FSARequest);
+#define FSAEX_ASYNC_MESSAGE_MAGIC 0x52415753 // "RAWS"
+
+// Number of message queues that can have asynchronous raw requests in flight at the same time.
+#define FSAEX_ASYNC_MAX_QUEUES    8
+
+namespace {
+    struct FSAExRawAsyncRequest {
+        FSAExAsyncData asyncData;
+        FSAShimBuffer *shim;
+        void *data;
+        void *alignedBuffer;
+        uint32_t size;
+        bool queueSlotReserved;
+        OSMessage ioMsg;
+    };
+
+    struct QueueInFlight {
+        OSMessageQueue *queue;
+        uint32_t count;
+    };
+
+    QueueInFlight sQueuesInFlight[FSAEX_ASYNC_MAX_QUEUES];
+    std::mutex sQueuesInFlightMutex;
+
+    // The completion can't be reported if the queue is full, so never have more requests in flight than the queue has messages.
+    bool ReserveQueueSlot(OSMessageQueue *queue) {
+        std::lock_guard lock(sQueuesInFlightMutex);
+        QueueInFlight *unused = nullptr;
+        for (auto &cur : sQueuesInFlight) {
+            if (cur.queue == queue) {
+                if (cur.count >= queue->size) {
+                    return false;
+                }
+                cur.count++;
+                return true;
+            }
+            if (!unused && cur.count == 0) {
+                unused = &cur;
+            }
+        }
+        if (!unused || queue->size == 0) {
+            return false;
+        }
+        unused->queue = queue;
+        unused->count = 1;
+        return true;
+    }
 
-    void *tmp = (void *) data;
-    if ((uint32_t) data & 0x3F) {
-        auto *alignedBuffer = memalign(0x40, ROUNDUP(size_bytes * cnt, 0x40));
-        if (!alignedBuffer) {
-            DEBUG_FUNCTION_LINE_ERR("Buffer not aligned (%p).", data);
-            return FS_ERROR_INVALID_ALIGNMENT;
+    void ReleaseQueueSlot(OSMessageQueue *queue) {
+        std::lock_guard lock(sQueuesInFlightMutex);
+        for (auto &cur : sQueuesInFlight) {
+            if (cur.queue == queue && cur.count > 0) {
+                cur.count--;
+                return;
+            }
         }
-        DEBUG_FUNCTION_LINE_WARN("Buffer not aligned (%p). Align to 0x40 for best performance", data);
-        tmp = alignedBuffer;
-        memcpy(tmp, data, size_bytes * cnt);
     }
 
-    shim->ioctlvVec[1].vaddr = tmp;
-    shim->ioctlvVec[1].len   = size_bytes * cnt;
+    // Called by the IPC driver once IOSU replied, don't do anything here that might block.
+    void RawAsyncCallback(IOSError error, void *context) {
+        auto *request = static_cast<FSAExRawAsyncRequest *>(context);
 
-    shim->ioctlvVec[2].vaddr = &shim->response;
-    shim->ioctlvVec[2].len   = sizeof(FSAResponse);
+        request->ioMsg.message = request;
+        request->ioMsg.args[0] = FSAEX_ASYNC_MESSAGE_MAGIC;
+        request->ioMsg.args[1] = static_cast<uint32_t>(error);
+        request->ioMsg.args[2] = 0;
+        // Can't fail, SubmitRawAsync made sure the queue has room for the message.
+        OSSendMessage(request->asyncData.ioMsgQueue, &request->ioMsg, OS_MESSAGE_FLAGS_NONE);
+    }
 
-    auto &request         = shim->request.rawWrite;
-    request.blocks_offset = blocks_offset;
-    request.count         = cnt;
-    request.size          = size_bytes;
-    request.device_handle = device_handle;
+    void FreeRawAsyncRequest(FSAExRawAsyncRequest *request) {
+        if (request->queueSlotReserved) {
+            ReleaseQueueSlot(request->asyncData.ioMsgQueue);
+        }
+        FSAShimPool_Release(request->shim);
+        free(request->alignedBuffer);
+        free(request);
+    }
 
-    auto res = __FSAShimSend(shim, 0);
+    FSError SubmitRawAsync(FSAClientHandle clientHandle, FSACommandEnum command, void *data, uint32_t size_bytes, uint32_t cnt, uint64_t blocks_offset, int device_handle, const FSAExAsyncData *asyncData) {
+        if (data == nullptr) {
+            return FS_ERROR_INVALID_BUFFER;
+        }
+        if (asyncData == nullptr || asyncData->ioMsgQueue == nullptr) {
+            return FS_ERROR_INVALID_PARAM;
+        }
+
+        auto *request = (FSAExRawAsyncRequest *) malloc(sizeof(FSAExRawAsyncRequest));
+        if (!request) {
+            return FS_ERROR_OUT_OF_RESOURCES;
+        }
+        memset(request, 0, sizeof(*request));
+        request->asyncData = *asyncData;
+        request->data      = data;
+        request->size      = size_bytes * cnt;
+
+        if (!ReserveQueueSlot(asyncData->ioMsgQueue)) {
+            DEBUG_FUNCTION_LINE_ERR("Message queue %p has no room for another request", asyncData->ioMsgQueue);
+            FreeRawAsyncRequest(request);
+            return FS_ERROR_OUT_OF_RESOURCES;
+        }
+        request->queueSlotReserved = true;
+
+        void *tmp = data;
+        if ((uintptr_t) data & 0x3F) {
+            // A single request can't be split, so only small ones go through a bounce buffer
+            if (request->size > FSA_RAW_BOUNCE_BUFFER_SIZE) {
+                DEBUG_FUNCTION_LINE_ERR("Buffer not aligned (%p) and 0x%08X bytes are too large for a bounce buffer.", data, request->size);
+                FreeRawAsyncRequest(request);
+                return FS_ERROR_INVALID_ALIGNMENT;
+            }
+            request->alignedBuffer = memalign(0x40, ROUNDUP(request->size, 0x40));
+            if (!request->alignedBuffer) {
+                DEBUG_FUNCTION_LINE_ERR("Buffer not aligned (%p).", data);
+                FreeRawAsyncRequest(request);
+                return FS_ERROR_INVALID_ALIGNMENT;
+            }
+            DEBUG_FUNCTION_LINE_WARN("Buffer not aligned (%p). Align to 0x40 for best performance", data);
+            tmp = request->alignedBuffer;
+            if (command == FSA_COMMAND_RAW_WRITE) {
+                memcpy(tmp, data, request->size);
+            }
+        }
+
+        request->shim = FSAShimPool_Acquire(clientHandle, command);
+        if (!request->shim) {
+            FreeRawAsyncRequest(request);
+            return FS_ERROR_INVALID_BUFFER;
+        }
+        auto *shim = request->shim;
 
-    if (tmp != data) {
-        free(tmp);
+        shim->ioctlvVec[1].vaddr = tmp;
+        shim->ioctlvVec[1].len   = request->size;
+
+        // raw read and raw write requests share the same layout
+        auto &rawRequest         = shim->request.rawRead;
+        rawRequest.blocks_offset = blocks_offset;
+        rawRequest.count         = cnt;
+        rawRequest.size          = size_bytes;
+        rawRequest.device_handle = device_handle;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Waddress-of-packed-member"
+        auto res = IOS_IoctlvAsync(shim->clientHandle, shim->command, shim->ioctlvVecIn, shim->ioctlvVecOut, shim->ioctlvVec, RawAsyncCallback, request);
+#pragma GCC diagnostic pop
+        if (res < 0) {
+            DEBUG_FUNCTION_LINE_ERR("IOS_IoctlvAsync failed: %d", res);
+            FreeRawAsyncRequest(request);
+            return __FSAShimDecodeIosErrorToFsaStatus(clientHandle, res);
+        }
+        return FS_ERROR_OK;
+    }
+} // namespace
+
+FSError FSAEx_RawReadAsync(FSAClientHandle clientHandle, void *data, uint32_t size_bytes, uint32_t cnt, uint64_t blocks_offset, int device_handle, const FSAExAsyncData *asyncData) {
+    return SubmitRawAsync(clientHandle, FSA_COMMAND_RAW_READ, data, size_bytes, cnt, blocks_offset, device_handle, asyncData);
+}
+
+FSError FSAEx_RawWriteAsync(FSAClientHandle clientHandle, const void *data, uint32_t size_bytes, uint32_t cnt, uint64_t blocks_offset, int device_handle, const FSAExAsyncData *asyncData) {
+    return SubmitRawAsync(clientHandle, FSA_COMMAND_RAW_WRITE, (void *) data, size_bytes, cnt, blocks_offset, device_handle, asyncData);
+}
+
+FSError FSAEx_RawAsyncHandleMessage(OSMessage *message, void **outParam) {
+    if (!message || !message->message || message->args[0] != FSAEX_ASYNC_MESSAGE_MAGIC) {
+        return FS_ERROR_INVALID_PARAM;
+    }
+    auto *request = static_cast<FSAExRawAsyncRequest *>(message->message);
+    // Decode the IOS error the same way __FSAShimSend does for synchronous requests
+    auto res = __FSAShimDecodeIosErrorToFsaStatus(request->shim->clientHandle, static_cast<IOSError>(message->args[1]));
+
+    if (res >= 0 && request->alignedBuffer && request->shim->command == FSA_COMMAND_RAW_READ) {
+        memcpy(request->data, request->alignedBuffer, request->size);
     }
 
-    free(shim);
+    const auto clientHandle = request->shim->clientHandle;
+    const auto asyncData    = request->asyncData;
+    void *data              = request->data;
+
+    // Free the request before calling the callback, the callback might submit a new request.
+    FreeRawAsyncRequest(request);
+
+    if (outParam) {
+        *outParam = asyncData.param;
+    }
+    if (asyncData.callback) {
+        asyncData.callback(clientHandle, data, res, asyncData.param);
+    }
     return res;
 }
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "logger.h"
+#include "mocha/fsa.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <coreinit/time.h>
+#include <malloc.h>
+#include <new>
+
+#define FSA_RAW_IMAGE_MAX_BUFFERS        8
+#define FSA_RAW_IMAGE_DEFAULT_BUFFERS    3
+#define FSA_RAW_IMAGE_CONSUMER_STACKSIZE 0x10000
+
+namespace {
+    struct RawImageContext {
+        const FSAExRawImageParams *params;
+
+        // buffers that can be filled by the reader
+        OSMessageQueue freeQueue{};
+        OSMessage freeMessages[FSA_RAW_IMAGE_MAX_BUFFERS]{};
+        // buffers that are ready for the consumer, +1 for the terminate message
+        OSMessageQueue fullQueue{};
+        OSMessage fullMessages[FSA_RAW_IMAGE_MAX_BUFFERS + 1]{};
+
+        std::atomic<uint64_t> consumedBytes{0};
+        std::atomic<int32_t> consumerResult{FS_ERROR_OK};
+    };
+
+    int RawImageConsumerThread(int argc, const char **argv) {
+        auto *ctx = (RawImageContext *) argv;
+        while (true) {
+            OSMessage message;
+            OSReceiveMessage(&ctx->fullQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+            if (!message.message) {
+                // terminate message, all chunks have been sent
+                break;
+            }
+
+            // Once the consumer has failed, only hand back the buffers so the reader can notice it.
+            if (ctx->consumerResult == FS_ERROR_OK) {
+                const uint32_t size   = message.args[0];
+                const uint64_t offset = ((uint64_t) message.args[1] << 32) | message.args[2];
+                FSError res           = ctx->params->consumer(message.message, size, offset, ctx->params->userData);
+                if (res < 0) {
+                    ctx->consumerResult = res;
+                } else {
+                    ctx->consumedBytes += size;
+                }
+            }
+
+            OSMessage freeMessage{};
+            freeMessage.message = message.message;
+            OSSendMessage(&ctx->freeQueue, &freeMessage, OS_MESSAGE_FLAGS_BLOCKING);
+        }
+        return 0;
+    }
+
+    void ReportProgress(RawImageContext *ctx, OSTime startTime, uint64_t totalBytes) {
+        if (!ctx->params->progress) {
+            return;
+        }
+        const uint64_t done = ctx->consumedBytes;
+        const uint64_t ms   = OSTicksToMilliseconds(OSGetTime() - startTime);
+        ctx->params->progress(done, totalBytes, ms > 0 ? (done * 1000) / ms : 0, ctx->params->userData);
+    }
+} // namespace
+
+FSError FSAEx_RawImage(FSAClientHandle clientHandle, int device_handle, const FSAExRawImageParams *params) {
+    if (!params || !params->consumer || params->sectorSize == 0 || params->sectorsPerChunk == 0 ||
+        (uint64_t) params->sectorSize * params->sectorsPerChunk > 0x7FFFFFFF ||
+        params->numBuffers == 1 || params->numBuffers > FSA_RAW_IMAGE_MAX_BUFFERS) {
+        return FS_ERROR_INVALID_PARAM;
+    }
+
+    const uint32_t numBuffers = params->numBuffers ? params->numBuffers : FSA_RAW_IMAGE_DEFAULT_BUFFERS;
+    const uint32_t chunkSize  = params->sectorSize * params->sectorsPerChunk;
+    const uint64_t totalBytes = params->numSectors * params->sectorSize;
+
+    auto *ctx = new (std::nothrow) RawImageContext;
+    if (!ctx) {
+        return FS_ERROR_OUT_OF_RESOURCES;
+    }
+    ctx->params = params;
+    OSInitMessageQueueEx(&ctx->freeQueue, ctx->freeMessages, numBuffers, "FSAEx_RawImage free");
+    OSInitMessageQueueEx(&ctx->fullQueue, ctx->fullMessages, numBuffers + 1, "FSAEx_RawImage full");
+
+    FSError result = FS_ERROR_OK;
+    void *buffers[FSA_RAW_IMAGE_MAX_BUFFERS]{};
+    for (uint32_t i = 0; i < numBuffers; i++) {
+        buffers[i] = memalign(0x40, ROUNDUP(chunkSize, 0x40));
+        if (!buffers[i]) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to allocate imaging buffer of %d bytes", chunkSize);
+            result = FS_ERROR_OUT_OF_RESOURCES;
+            break;
+        }
+        OSMessage message{};
+        message.message = buffers[i];
+        OSSendMessage(&ctx->freeQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+    }
+
+    auto *thread = (OSThread *) memalign(0x10, sizeof(OSThread));
+    auto *stack  = (uint8_t *) memalign(0x10, FSA_RAW_IMAGE_CONSUMER_STACKSIZE);
+    if (result == FS_ERROR_OK && (!thread || !stack)) {
+        DEBUG_FUNCTION_LINE_ERR("Failed to allocate consumer thread");
+        result = FS_ERROR_OUT_OF_RESOURCES;
+    }
+
+    bool threadStarted = false;
+    if (result == FS_ERROR_OK) {
+        auto affinity = params->consumerAffinity;
+        if (affinity == 0) {
+            // Use a different core than the reader
+            affinity = (OSThreadAttributes) (1 << ((OSGetCoreId() + 1) % 3));
+        }
+        if (!OSCreateThread(thread, RawImageConsumerThread, 0, (char *) ctx, stack + FSA_RAW_IMAGE_CONSUMER_STACKSIZE, FSA_RAW_IMAGE_CONSUMER_STACKSIZE,
+                            OSGetThreadPriority(OSGetCurrentThread()), affinity)) {
+            DEBUG_FUNCTION_LINE_ERR("Failed to create consumer thread");
+            result = FS_ERROR_OUT_OF_RESOURCES;
+        } else {
+            OSSetThreadName(thread, "FSAEx_RawImage consumer");
+            OSResumeThread(thread);
+            threadStarted = true;
+        }
+    }
+
+    if (threadStarted) {
+        const OSTime startTime = OSGetTime();
+        uint64_t sector        = params->startSector;
+        uint64_t remaining     = params->numSectors;
+        while (remaining > 0) {
+            // Only blocks if the consumer is behind by all buffers.
+            OSMessage message;
+            OSReceiveMessage(&ctx->freeQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+            if (ctx->consumerResult != FS_ERROR_OK) {
+                break;
+            }
+            ReportProgress(ctx, startTime, totalBytes);
+
+            const auto count = (uint32_t) std::min<uint64_t>(remaining, params->sectorsPerChunk);
+            FSError res      = FSAEx_RawReadEx(clientHandle, message.message, params->sectorSize, count, sector, device_handle);
+            if (res < 0) {
+                DEBUG_FUNCTION_LINE_ERR("FSAEx_RawReadEx(0x%08X, %p, %d, %d, %lld, 0x%08X) failed: %s", clientHandle, message.message, params->sectorSize, count, sector, device_handle, FSAGetStatusStr(res));
+                result = res;
+                break;
+            }
+
+            const uint64_t offset = sector * params->sectorSize;
+            message.args[0]       = count * params->sectorSize;
+            message.args[1]       = (uint32_t) (offset >> 32);
+            message.args[2]       = (uint32_t) offset;
+            OSSendMessage(&ctx->fullQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+
+            sector += count;
+            remaining -= count;
+        }
+
+        OSMessage terminate{};
+        OSSendMessage(&ctx->fullQueue, &terminate, OS_MESSAGE_FLAGS_BLOCKING);
+        int threadResult;
+        OSJoinThread(thread, &threadResult);
+
+        if (result == FS_ERROR_OK) {
+            result = (FSError) ctx->consumerResult.load();
+        }
+        ReportProgress(ctx, startTime, totalBytes);
+    }
+
+    free(stack);
+    free(thread);
+    for (auto *buffer : buffers) {
+        free(buffer);
+    }
+    delete ctx;
+    return result;
+}
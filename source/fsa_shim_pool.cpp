@@ -0,0 +1,133 @@
+#include "fsa_shim_pool.h"
+#include "mocha/fsa.h"
+#include "utils.h"
+#include <malloc.h>
+#include <mutex>
+
+namespace {
+    struct ALIGN_0x40 ShimPoolEntry {
+        FSAShimBuffer shim;
+        bool inUse;
+        // client handle and command the shim has been set up for
+        FSAClientHandle templateClientHandle;
+        FSACommandEnum templateCommand;
+        bool templateValid;
+    };
+
+    ShimPoolEntry sShimPool[FSA_SHIM_POOL_SIZE];
+    FSAExShimPoolStats sShimPoolStats{};
+    std::mutex sShimPoolMutex;
+
+    void setupShimTemplate(FSAShimBuffer *shim, FSAClientHandle clientHandle, FSACommandEnum command) {
+        shim->clientHandle = clientHandle;
+        shim->command      = command;
+
+        switch (command) {
+            case FSA_COMMAND_RAW_READ:
+            case FSA_COMMAND_READ_FILE:
+                shim->ipcReqType   = FSA_IPC_REQUEST_IOCTLV;
+                shim->ioctlvVecIn  = uint8_t{1};
+                shim->ioctlvVecOut = uint8_t{2};
+                break;
+            case FSA_COMMAND_RAW_WRITE:
+            case FSA_COMMAND_WRITE_FILE:
+                shim->ipcReqType   = FSA_IPC_REQUEST_IOCTLV;
+                shim->ioctlvVecIn  = uint8_t{2};
+                shim->ioctlvVecOut = uint8_t{1};
+                break;
+            default:
+                shim->ipcReqType = FSA_IPC_REQUEST_IOCTL;
+                return;
+        }
+
+        shim->ioctlvVec[0].vaddr = &shim->request;
+        shim->ioctlvVec[0].len   = sizeof(FSARequest);
+
+        shim->ioctlvVec[2].vaddr = &shim->response;
+        shim->ioctlvVec[2].len   = sizeof(FSAResponse);
+    }
+
+    bool isPoolBuffer(const FSAShimBuffer *shim) {
+        auto addr = reinterpret_cast<uintptr_t>(shim);
+        return addr >= reinterpret_cast<uintptr_t>(&sShimPool[0]) && addr < reinterpret_cast<uintptr_t>(&sShimPool[FSA_SHIM_POOL_SIZE]);
+    }
+} // namespace
+
+FSAShimBuffer *FSAShimPool_Acquire(FSAClientHandle clientHandle, FSACommandEnum command) {
+    ShimPoolEntry *entry = nullptr;
+    {
+        std::lock_guard lock(sShimPoolMutex);
+        // Prefer a buffer that has already been set up for this client and command.
+        for (auto &cur : sShimPool) {
+            if (cur.inUse) {
+                continue;
+            }
+            if (cur.templateValid && cur.templateClientHandle == clientHandle && cur.templateCommand == command) {
+                entry = &cur;
+                sShimPoolStats.templateHits++;
+                break;
+            }
+            if (!entry) {
+                entry = &cur;
+            }
+        }
+        if (entry) {
+            entry->inUse = true;
+            sShimPoolStats.poolHits++;
+            sShimPoolStats.inUse++;
+        } else {
+            sShimPoolStats.poolMisses++;
+        }
+    }
+
+    if (!entry) {
+        // The pool is exhausted, fall back to a temporary buffer.
+        auto *shim = (FSAShimBuffer *) memalign(0x40, sizeof(FSAShimBuffer));
+        if (shim) {
+            setupShimTemplate(shim, clientHandle, command);
+            shim->response.word0 = 0xFFFFFFFF;
+        }
+        return shim;
+    }
+
+    // Only this thread owns the entry now, no need to hold the lock.
+    if (!entry->templateValid || entry->templateClientHandle != clientHandle || entry->templateCommand != command) {
+        setupShimTemplate(&entry->shim, clientHandle, command);
+        entry->templateClientHandle = clientHandle;
+        entry->templateCommand      = command;
+        entry->templateValid        = true;
+    }
+    entry->shim.response.word0 = 0xFFFFFFFF;
+    return &entry->shim;
+}
+
+void FSAShimPool_Release(FSAShimBuffer *shim) {
+    if (!shim) {
+        return;
+    }
+    if (!isPoolBuffer(shim)) {
+        free(shim);
+        return;
+    }
+    const auto index = (reinterpret_cast<uintptr_t>(shim) - reinterpret_cast<uintptr_t>(&sShimPool[0])) / sizeof(ShimPoolEntry);
+
+    std::lock_guard lock(sShimPoolMutex);
+    sShimPool[index].inUse = false;
+    sShimPoolStats.inUse--;
+}
+
+void FSAEx_GetShimPoolStats(FSAExShimPoolStats *outStats) {
+    if (!outStats) {
+        return;
+    }
+    std::lock_guard lock(sShimPoolMutex);
+    *outStats          = sShimPoolStats;
+    outStats->capacity = FSA_SHIM_POOL_SIZE;
+}
+
+void FSAEx_ResetShimPoolStats() {
+    std::lock_guard lock(sShimPoolMutex);
+    sShimPoolStats.poolHits     = 0;
+    sShimPoolStats.poolMisses   = 0;
+    sShimPoolStats.templateHits = 0;
+}
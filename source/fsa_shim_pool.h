@@ -0,0 +1,25 @@
+#pragma once
+#include <coreinit/filesystem_fsa.h>
+#include <stdint.h>
+
+// Number of FSAShimBuffers that are kept around for reuse.
+#define FSA_SHIM_POOL_SIZE 8
+
+/**
+ * Returns a 0x40 aligned FSAShimBuffer which has been prepared for the given client handle and command. <br>
+ * The ipc request type, the ioctlv vector counts and the request/response vectors are already set up,
+ * the caller only needs to fill in the command specific request fields (and the data vector for reads/writes). <br>
+ * If all pooled buffers are in use, a new buffer will be allocated.
+ *
+ * @param clientHandle /dev/fsa handle the request will be sent to
+ * @param command FSA_COMMAND_RAW_OPEN, FSA_COMMAND_RAW_CLOSE, FSA_COMMAND_RAW_READ, FSA_COMMAND_RAW_WRITE,
+ *                FSA_COMMAND_READ_FILE or FSA_COMMAND_WRITE_FILE
+ * @return prepared shim buffer or NULL if the allocation failed
+ */
+FSAShimBuffer *FSAShimPool_Acquire(FSAClientHandle clientHandle, FSACommandEnum command);
+
+/**
+ * Returns a buffer that has been acquired via FSAShimPool_Acquire.
+ * @param shim
+ */
+void FSAShimPool_Release(FSAShimBuffer *shim);
@@ -7,6 +7,11 @@
 #define ALIGN_0x40                   ALIGN(0x40)
 #define ROUNDUP(x, align)            (((x) + ((align) -1)) & ~((align) -1))
 
+#ifdef __WUT__
 #define __FSAShimSetupRequestMount   ((FSError(*)(FSAShimBuffer *, uint32_t, const char *, const char *, uint32_t, void *, uint32_t))(0x101C400 + 0x042f88))
 #define __FSAShimSetupRequestUnmount ((FSError(*)(FSAShimBuffer *, uint32_t, const char *, uint32_t))(0x101C400 + 0x43130))
 #define __FSAShimSend                ((FSError(*)(FSAShimBuffer *, uint32_t))(0x101C400 + 0x042d90))
+#else
+// Host builds (see bench/host) link against stub implementations of the shim functions.
+FSError __FSAShimSend(FSAShimBuffer *shim, uint32_t flags);
+#endif